@@ -0,0 +1,23 @@
+#pragma once
+#include "utils/SpscRing.hpp"
+
+enum class CommandType
+{
+    Seek,     // value: seconds to move by
+    Step,     // value: 1 one frame forward, -1 one back
+    Speed,    // value: the new rate
+    Reverse,  // flips the direction
+    SeekMode  // on to the next of exact, fast and snap
+};
+
+struct PlayerCommand
+{
+    CommandType type{CommandType::Seek};
+    double value{0.0};
+};
+
+/* From the input callbacks to the playback loop, which drains it at the
+ * top of every iteration and while it waits for a seek to land. Seeks
+ * queued together merge into one target. A full channel drops the
+ * command rather than hold up the event loop. */
+extern SpscRing<PlayerCommand> commands;
@@ -0,0 +1,85 @@
+#include "FrameCache.hpp"
+
+FrameCache::FrameCache(std::size_t budget):
+    budget_{budget}
+{}
+
+void FrameCache::put(const Picture &pic)
+{
+    Frame* src = pic.frame.get();
+    if(!src || pic.pts == AV_NOPTS_VALUE) return;
+    auto it = entries_.find(pic.pts);
+    if(it != entries_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return;
+    }
+    int size = av_image_get_buffer_size(src->format(), src->width(), src->height(), 1);
+    if(size <= 0 || static_cast<std::size_t>(size) > budget_) return;
+    while(bytes_ + size > budget_)
+    {
+        auto old = entries_.find(lru_.back());
+        bytes_ -= old->second.bytes;
+        entries_.erase(old);
+        lru_.pop_back();
+        evictions_++;
+    }
+
+    auto copy = std::make_unique<Picture>();
+    copy->pts = pic.pts;
+    copy->frame = std::make_unique<Frame>();
+    copy->source_height = pic.source_height;
+    PixelLayout layout;
+    // a scaled down picture lives in the pool like an RGB0 one
+    bool decoded = shaderLayout(src->format(), &layout) && !pic.source_height;
+    bool ok = decoded ? copy->frame->ref(src) : copy->frame->copy(src);
+    if(!ok) return;
+    lru_.push_front(pic.pts);
+    entries_.emplace(pic.pts, Entry{std::move(copy), static_cast<std::size_t>(size), lru_.begin()});
+    bytes_ += size;
+}
+
+Picture *FrameCache::use(std::map<int64_t, Entry>::iterator it, bool found)
+{
+    if(!found)
+    {
+        misses_++;
+        return nullptr;
+    }
+    hits_++;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.pic.get();
+}
+
+Picture *FrameCache::before(int64_t pts, int64_t max_gap)
+{
+    auto it = entries_.lower_bound(pts);
+    if(it == entries_.begin()) return use(it, false);
+    --it;
+    return use(it, pts - it->first <= max_gap);
+}
+
+Picture *FrameCache::after(int64_t pts, int64_t max_gap)
+{
+    auto it = entries_.upper_bound(pts);
+    return use(it, it != entries_.end() && it->first - pts <= max_gap);
+}
+
+void FrameCache::clear()
+{
+    entries_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+FrameCacheStats FrameCache::stats()
+{
+    FrameCacheStats st;
+    st.hits = hits_;
+    st.misses = misses_;
+    st.evictions = evictions_;
+    st.entries = entries_.size();
+    st.bytes = bytes_;
+    st.budget = budget_;
+    return st;
+}
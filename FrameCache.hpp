@@ -0,0 +1,46 @@
+#pragma once
+#include "Pipeline.hpp"
+#include <map>
+#include <list>
+
+struct FrameCacheStats
+{
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};
+    std::size_t entries{0};
+    std::size_t bytes{0};
+    std::size_t budget{0};
+};
+
+/* Pictures already presented, keyed by pts, the least recently used
+ * evicted once their bytes pass the budget. Frames the shader samples
+ * are kept by reference; RGB0 and scaled down pictures are copied into
+ * buffers of the cache's own, so a pipeline's FramePool isn't held
+ * up. before() and after() find the neighbour of a pts no further than
+ * max_gap away and count a hit or a miss. */
+class FrameCache
+{
+private:
+    struct Entry
+    {
+        std::unique_ptr<Picture> pic;
+        std::size_t bytes;
+        std::list<int64_t>::iterator lru;
+    };
+    std::map<int64_t, Entry> entries_;
+    std::list<int64_t> lru_;  // most recently used first
+    std::size_t budget_;
+    std::size_t bytes_{0};
+    uint64_t hits_{0};
+    uint64_t misses_{0};
+    uint64_t evictions_{0};
+    Picture* use(std::map<int64_t, Entry>::iterator it, bool found);
+public:
+    explicit FrameCache(std::size_t budget);
+    void put(const Picture& pic);
+    Picture* before(int64_t pts, int64_t max_gap);
+    Picture* after(int64_t pts, int64_t max_gap);
+    void clear();
+    FrameCacheStats stats();
+};
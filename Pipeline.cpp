@@ -0,0 +1,372 @@
+#include "Pipeline.hpp"
+#include "utils/Trace.hpp"
+#include <limits>
+#include <algorithm>
+
+static const double no_audio_target = -std::numeric_limits<double>::infinity();
+static const double no_clock = -std::numeric_limits<double>::infinity();
+static const double nonref_speed{2.0};
+static const double keyframe_speed{8.0};
+
+bool shaderLayout(AVPixelFormat fmt, PixelLayout* layout)
+{
+    switch(fmt)
+    {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+        *layout = PixelLayout::YUV420P;
+        return true;
+    case AV_PIX_FMT_NV12:
+        *layout = PixelLayout::NV12;
+        return true;
+    case AV_PIX_FMT_YUV420P10:
+    case AV_PIX_FMT_YUV420P12:
+        *layout = PixelLayout::YUV420P16;
+        return true;
+    case AV_PIX_FMT_P010:
+    case AV_PIX_FMT_P016:
+        *layout = PixelLayout::P010;
+        return true;
+    default: break;
+    }
+    return false;
+}
+
+ImagePlanes Picture::planes()
+{
+    ImagePlanes img;
+    if(!frame) return img;
+    img.width = frame->width();
+    img.height = frame->height();
+    for(int i{0}; i < 3; i++)
+    {
+        img.data[i] = frame->_data()[i];
+        img.linesize[i] = frame->linesize()[i];
+    }
+    if(!shaderLayout(frame->format(), &img.layout))
+    {
+        img.layout = PixelLayout::RGBA;
+        return img;
+    }
+    switch(frame->colorSpace())
+    {
+    case AVCOL_SPC_BT709: img.matrix = ColorMatrix::BT709; break;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M: img.matrix = ColorMatrix::BT601; break;
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL: img.matrix = ColorMatrix::BT2020; break;
+    // guessed from the size it was decoded at
+    default: img.matrix = (source_height ? source_height : img.height) >= 720 ? ColorMatrix::BT709 : ColorMatrix::BT601; break;
+    }
+    img.full_range = frame->colorRange() == AVCOL_RANGE_JPEG || frame->format() == AV_PIX_FMT_YUVJ420P;
+    switch(frame->format())
+    {
+    case AV_PIX_FMT_YUV420P10: img.depth = 10; break;
+    case AV_PIX_FMT_YUV420P12: img.depth = 12; break;
+    case AV_PIX_FMT_P010:
+    case AV_PIX_FMT_P016: img.depth = 16; break;
+    default: break;
+    }
+    switch(frame->colorTransfer())
+    {
+    case AVCOL_TRC_SMPTE2084: img.transfer = TransferCurve::PQ; break;
+    case AVCOL_TRC_ARIB_STD_B67: img.transfer = TransferCurve::HLG; break;
+    default: break;
+    }
+    return img;
+}
+
+Pipeline::Pipeline(Decoder *dec, AudioPlayer *audio, const DropPolicy &policy, std::size_t packet_depth,
+                   std::size_t frame_depth, std::size_t picture_depth, std::size_t pool_capacity):
+    dec_{dec},
+    audio_{dec->hasAudio() ? audio : nullptr},
+    policy_{policy},
+    pool_{std::make_unique<FramePool>(av_image_get_buffer_size(AV_PIX_FMT_RGB0, dec->width(), dec->height(), 64), pool_capacity)},
+    packets_{packet_depth},
+    frames_{frame_depth},
+    ready_{picture_depth},
+    audio_packets_{packet_depth * 4},
+    audio_target_{no_audio_target},
+    present_clock_{no_clock}
+{}
+
+Pipeline::~Pipeline()
+{
+    stop();
+}
+
+void Pipeline::prime()
+{
+    if(!workers_.empty()) return;
+    workers_.emplace_back(&Pipeline::demux, this);
+    workers_.emplace_back(&Pipeline::decode, this);
+    workers_.emplace_back(&Pipeline::convert, this);
+    primed_ = true;
+}
+
+void Pipeline::start()
+{
+    if(!workers_.empty() && !primed_) return;
+    prime();
+    primed_ = false;
+    if(playsAudio()) workers_.emplace_back(&Pipeline::decodeAudio, this);
+}
+
+bool Pipeline::playsAudio()
+{
+    return audio_ && speed_ == 1.0;
+}
+
+// what the decoder may skip at this speed, a fast seek skips non reference frames until its target
+void Pipeline::applyDiscard()
+{
+    dec_->fastDecode(fast_seek_ || speed_ >= nonref_speed);
+    if(speed_ >= keyframe_speed) dec_->keyframesOnly(true);
+}
+
+/* Waits for every stage to run out at end of stream. Unlike stop()
+ * the audio already written keeps playing, so the next item follows
+ * without a gap. */
+void Pipeline::finish()
+{
+    for(auto& t : workers_) t.join();
+    workers_.clear();
+    primed_ = false;
+}
+
+// added to the audio pts handed to the AudioPlayer, set before start()
+void Pipeline::setTimeOffset(double sec)
+{
+    time_offset_ = sec;
+}
+
+/* Stops the stages, the next seek() or start() runs them at the new
+ * speed. Seeking to where the picture is keeps playback continuous,
+ * the decoder needs a keyframe to leave keyframe only decoding. */
+void Pipeline::setSpeed(double speed)
+{
+    stop();
+    speed_ = speed;
+}
+
+void Pipeline::stop()
+{
+    if(workers_.empty()) return;
+    packets_.abort();
+    frames_.abort();
+    ready_.abort();
+    audio_packets_.abort();
+    pool_->abort();
+    if(audio_) audio_->interrupt(true);
+    for(auto& t : workers_) t.join();
+    workers_.clear();
+    primed_ = false;
+
+    packets_.reset();
+    frames_.reset();
+    ready_.reset();
+    audio_packets_.reset();
+    pool_->reset();
+    packets_.clear();
+    frames_.clear();
+    ready_.clear();
+    audio_packets_.clear();
+    if(audio_)
+    {
+        audio_->flush();
+        audio_->interrupt(false);
+    }
+    fast_seek_ = false;
+    applyDiscard();
+}
+
+void Pipeline::seek(int64_t ts, SeekMode mode)
+{
+    stop();
+    int64_t landed = dec_->seek(ts);
+    target_pts_ = mode == SeekMode::Snap ? AV_NOPTS_VALUE : ts;
+    audio_target_ = (mode == SeekMode::Snap ? landed : ts) * av_q2d(dec_->timeBase());
+    fast_seek_ = mode == SeekMode::Fast;
+    applyDiscard();
+    present_clock_ = no_clock;
+    start();
+}
+
+bool Pipeline::nextPicture(std::unique_ptr<Picture> &pic)
+{
+    if(!ready_.pop(pic)) return false;
+    return pic != nullptr;
+}
+
+// nextPicture() won't block, or wait_ms passed
+bool Pipeline::pictureReady(int wait_ms)
+{
+    return ready_.waitFor(std::chrono::milliseconds(wait_ms));
+}
+
+// stream seconds the presenter has reached, lets convert() skip frames that are already too late
+void Pipeline::presentClock(double sec)
+{
+    present_clock_.store(sec, std::memory_order_relaxed);
+}
+
+/* Size pictures are shown at, set by the presenter whenever the window
+ * may have changed. Frames already converted keep their size, the
+ * renderer scales the few left in the queue. */
+void Pipeline::outputSize(int width, int height)
+{
+    output_size_.store(static_cast<uint64_t>(std::max(width, 0)) << 32 | static_cast<uint32_t>(std::max(height, 0)),
+                       std::memory_order_relaxed);
+}
+
+PipelineStats Pipeline::stats()
+{
+    return PipelineStats{packets_.stats(), frames_.stats(), ready_.stats(), audio_packets_.stats(), pool_->stats(),
+                         dropped_.load(), decimated_.load()};
+}
+
+void Pipeline::demux()
+{
+    VPL_TRACE_THREAD("demux");
+    while(true)
+    {
+        auto p = std::make_unique<Packet>();
+        if(!dec_->readPacket(p.get()))
+        {
+            packets_.push(nullptr);
+            if(playsAudio()) audio_packets_.push(nullptr);
+            return;
+        }
+        if(dec_->isAudio(p.get()))
+        {
+            if(playsAudio() && !audio_packets_.push(std::move(p))) return;
+            continue;
+        }
+        if(!packets_.push(std::move(p))) return;
+    }
+}
+
+void Pipeline::decode()
+{
+    VPL_TRACE_THREAD("decode");
+    int eof{0};
+    std::unique_ptr<Packet> p;
+    while(packets_.pop(p))
+    {
+        // full quality from the first packet at or past the target, its references were kept;
+        // a packet without timestamps can't be placed, so give up on the target there
+        if(p && p->timeStamp() == AV_NOPTS_VALUE) target_pts_ = AV_NOPTS_VALUE;
+        if(fast_seek_ && (!p || target_pts_ == AV_NOPTS_VALUE || p->timeStamp() >= target_pts_))
+        {
+            fast_seek_ = false;
+            applyDiscard();
+        }
+        if(!dec_->sendPacket(p.get(), &eof)) break;
+        while(true)
+        {
+            auto f = std::make_unique<Frame>();
+            if(!dec_->receiveFrame(f.get())) break;
+            if(target_pts_ != AV_NOPTS_VALUE)
+            {
+                if(f->timeStamp() != AV_NOPTS_VALUE && f->timeStamp() < target_pts_) continue;
+                target_pts_ = AV_NOPTS_VALUE;
+            }
+            if(!frames_.push(std::move(f))) return;
+        }
+        if(eof == 1) break;
+    }
+    frames_.push(nullptr);
+}
+
+void Pipeline::convert()
+{
+    VPL_TRACE_THREAD("convert");
+    std::unique_ptr<Frame> f;
+    double tb = av_q2d(dec_->timeBase());
+    // a bit under the sped up frame interval, so timestamp jitter doesn't leave out a frame that should stay
+    double keep_every = dec_->fps() > 0.0 ? (speed_ - 0.5) / dec_->fps() : 0.0;
+    double next_keep{no_clock};
+    int skipped{0}, decimated{0};
+    while(frames_.pop(f))
+    {
+        if(!f) break;
+        if(speed_ > 1.0 && f->timeStamp() != AV_NOPTS_VALUE)
+        {
+            double t = f->timeStamp() * tb;
+            if(t < next_keep)
+            {
+                decimated++;
+                decimated_++;
+                continue;
+            }
+            next_keep = t + keep_every;
+        }
+        if(policy_.convert_drop_ms > 0.0 && skipped < policy_.max_consecutive && f->timeStamp() != AV_NOPTS_VALUE)
+        {
+            double behind = (present_clock_.load(std::memory_order_relaxed) - f->timeStamp() * tb) * 1000.0;
+            if(behind > policy_.convert_drop_ms)
+            {
+                skipped++;
+                dropped_++;
+                continue;
+            }
+        }
+        auto pic = std::make_unique<Picture>();
+        pic->pts = f->timeStamp();
+        pic->skipped = skipped + decimated;
+        skipped = decimated = 0;
+        uint64_t out = output_size_.load(std::memory_order_relaxed);
+        int out_w = static_cast<int>(out >> 32) & ~1, out_h = static_cast<int>(out & 0xffffffff) & ~1;
+        bool smaller = out_w > 0 && out_h > 0 && out_w < f->width() && out_h <= f->height();
+        PixelLayout layout;
+        bool shader = shaderLayout(f->format(), &layout);
+        // the shader samples any size, shrinking first only pays off when it saves most of the upload
+        if(shader && !(smaller && out_w * 2 <= f->width()))
+        {
+            pic->frame = std::move(f);
+        }
+        else
+        {
+            int w = smaller ? out_w : f->width(), h = smaller ? out_h : f->height();
+            if(smaller) pic->source_height = f->height();
+            // high bit depth stays so when shrunk
+            AVPixelFormat to = AV_PIX_FMT_RGB0;
+            if(shader) to = layout == PixelLayout::YUV420P16 || layout == PixelLayout::P010 ? AV_PIX_FMT_YUV420P10 : AV_PIX_FMT_YUV420P;
+            pic->frame = std::make_unique<Frame>();
+            if(!pic->frame->allocate(pool_.get(), w, h, to)) break;
+            if(!dec_->convertFrame(f.get(), pic->frame.get()))
+            {
+                std::cerr << "Couldn't convert video frame." << "\n";
+                break;
+            }
+        }
+        if(!ready_.push(std::move(pic))) return;
+    }
+    ready_.push(nullptr);
+}
+
+void Pipeline::decodeAudio()
+{
+    VPL_TRACE_THREAD("audio decode");
+    int eof{0};
+    std::unique_ptr<Packet> p;
+    Frame f;
+    std::vector<float> pcm;
+    AVRational tb = dec_->audioTimeBase();
+    while(audio_packets_.pop(p))
+    {
+        // a broken audio packet only costs a gap in the sound
+        if(!dec_->sendAudioPacket(p.get(), &eof)) continue;
+        while(dec_->receiveAudioFrame(&f))
+        {
+            int64_t ts = f.timeStamp();
+            int n = dec_->convertAudio(&f, pcm);
+            if(n <= 0 || ts == AV_NOPTS_VALUE) continue;
+            double pts = ts * av_q2d(tb);
+            if(pts < audio_target_) continue;
+            audio_target_ = no_audio_target;
+            if(!audio_->write(pcm.data(), n, pts + time_offset_)) return;
+        }
+        if(eof == 1) break;
+    }
+}
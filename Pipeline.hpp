@@ -0,0 +1,111 @@
+#pragma once
+#include "ffmpeg/Decoder.hpp"
+#include "utils/BoundedQueue.hpp"
+#include "window/ImagePlanes.hpp"
+#include "audio/AudioPlayer.hpp"
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+/* Either a decoded frame the renderer converts itself, or an RGB0
+ * frame produced by scale_image into a pool buffer for formats the
+ * shader can't sample. Dropping the picture returns its buffers.
+ * Its size is the frame's, which may be under the decoded one. */
+struct Picture
+{
+    std::unique_ptr<Frame> frame;
+    int64_t pts{0};
+    int skipped{0};  // frames dropped late right before this one
+    int source_height{0};  // as decoded, when the frame was scaled down
+    ImagePlanes planes();
+};
+
+// formats the shader samples as they are, anything else is converted to RGB0 first
+bool shaderLayout(AVPixelFormat fmt, PixelLayout* layout);
+
+struct PipelineStats
+{
+    QueueStats packets;
+    QueueStats frames;
+    QueueStats pictures;
+    QueueStats audio_packets;
+    PoolStats pool;
+    uint64_t dropped{0};  // late frames dropped before conversion
+    uint64_t decimated{0};  // frames left out to play faster
+};
+
+/* How far behind the presentation clock, in ms, a frame counts as late
+ * and gets dropped. Conversion drops on the clock the presenter last
+ * published, so it uses a wider margin than the drop before paint.
+ * A drop threshold of 0 turns that drop off; max_consecutive keeps the
+ * picture moving on a machine that can never catch up. */
+struct DropPolicy
+{
+    double late_ms{10.0};
+    double present_drop_ms{40.0};
+    double convert_drop_ms{100.0};
+    int max_consecutive{5};
+};
+
+/* Runs demux, decode and color conversion on their own threads.
+ * Stages hand work over through bounded queues, the presenting thread
+ * only takes pictures that are already converted. With an AudioPlayer
+ * the demuxer also feeds an audio decode thread writing to it.
+ * prime() starts only the video stages, so the next playlist item can
+ * fill its queues while the AudioPlayer still plays the current one;
+ * start() adds whatever isn't running yet.
+ * Away from 1x there is no sound. Faster than that, frames closer than
+ * a frame interval of the sped up clock are left out before
+ * conversion, from 2x the decoder skips non reference frames and from
+ * 8x it decodes keyframes only.
+ * With an output size under the decoded one, pictures that are
+ * converted anyway are scaled to it in the same pass, and frames the
+ * shader would sample are shrunk to yuv420p (yuv420p10 from 10 bits
+ * up) first once they are at least twice that size. */
+class Pipeline
+{
+private:
+    Decoder* dec_;
+    AudioPlayer* audio_;
+    DropPolicy policy_;
+    // declared before the queues so it outlives any picture left in them
+    std::unique_ptr<FramePool> pool_;
+    BoundedQueue<std::unique_ptr<Packet>> packets_;
+    BoundedQueue<std::unique_ptr<Frame>> frames_;
+    BoundedQueue<std::unique_ptr<Picture>> ready_;
+    BoundedQueue<std::unique_ptr<Packet>> audio_packets_;
+    std::vector<std::thread> workers_;
+    int64_t target_pts_{AV_NOPTS_VALUE};
+    double audio_target_;
+    bool fast_seek_{false};
+    bool primed_{false};
+    double time_offset_{0.0};
+    double speed_{1.0};
+    std::atomic<double> present_clock_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> decimated_{0};
+    std::atomic<uint64_t> output_size_{0};  // width << 32 | height, 0 for the decoded size
+    bool playsAudio();
+    void applyDiscard();
+    void demux();
+    void decode();
+    void convert();
+    void decodeAudio();
+public:
+    Pipeline(Decoder* dec, AudioPlayer* audio = nullptr, const DropPolicy& policy = DropPolicy{}, std::size_t packet_depth = 32,
+             std::size_t frame_depth = 4, std::size_t picture_depth = 3, std::size_t pool_capacity = 5);
+    ~Pipeline();
+    void prime();
+    void start();
+    void finish();
+    void stop();
+    void setTimeOffset(double sec);
+    void setSpeed(double speed);
+    void seek(int64_t ts, SeekMode mode = SeekMode::Exact);
+    bool nextPicture(std::unique_ptr<Picture>& pic);
+    bool pictureReady(int wait_ms);
+    void presentClock(double sec);
+    void outputSize(int width, int height);
+    PipelineStats stats();
+};
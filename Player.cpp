@@ -1,11 +1,20 @@
 #include "Player.hpp"
+#include "utils/Trace.hpp"
 #include <vector>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
 
-bool b_pause_play{false};
-bool b_seekable{false};
-std::size_t idx{0};
-double frame_per_sec{0.0};
+// written by the key and window callbacks, read by the playback loop
+std::atomic<bool> b_pause_play{false};
+std::atomic<std::size_t> idx{0};
+std::atomic<double> play_speed{1.0};
+std::atomic<bool> b_redraw{false};
+SpscRing<PlayerCommand> commands{64};
+
+// how long a wait for a seek to land blocks before input is looked at again
+static const int seek_poll_ms{10};
 
 void Player::updateCounter(int id)
 {
@@ -24,12 +33,82 @@ void Player::updateCounter(int id)
     if(hr < 10) shr = "0"+std::to_string(hr);
     else shr = std::to_string(hr);
     std::string newTitle = "VPL   " + shr+":"+smin+":"+ssec+" - " + video_dur;
+    if(speed != 1.0)
+    {
+        char rate[16];
+        std::snprintf(rate, sizeof(rate), "   %gx", speed);
+        newTitle += rate;
+    }
+    if(reverse) newTitle += "   reverse";
+    if(seek_mode == SeekMode::Fast) newTitle += "   fast seek";
+    else if(seek_mode == SeekMode::Snap) newTitle += "   snap seek";
     glfwSetWindowTitle(rnd->window(), newTitle.c_str());
+    counter_id = id;
+}
+
+static std::unique_ptr<AudioPlayer> open_audio(Decoder* dec)
+{
+    if(!dec->hasAudio()) return nullptr;
+    auto out = std::make_unique<AudioPlayer>(dec->audioRate(), dec->audioChannels());
+    if(!out->ok())
+    {
+        std::cerr << "Playing without sound." << "\n";
+        return nullptr;
+    }
+    return out;
 }
 
-Player::Player(const std::string &file_path):
-    rnd{std::make_unique<VPLRender>()},
-    dec{std::make_unique<Decoder>(file_path)}
+static std::size_t frame_at(Decoder* dec, double sec)
+{
+    int64_t start = dec->startTime();
+    double start_sec = start != AV_NOPTS_VALUE ? start * av_q2d(dec->timeBase()) : 0.0;
+    return static_cast<std::size_t>(std::max(0.0, std::round((sec - start_sec) * dec->fps())));
+}
+
+static DecoderOptions decoder_options(const PlayerOptions& opts)
+{
+    DecoderOptions d;
+    d.audio = true;
+    d.index_scan = true;
+    d.read_mode = opts.read_mode;
+    d.read_ahead = opts.read_ahead;
+    d.probe = opts.probe;
+    d.lowres = opts.lowres;
+    return d;
+}
+
+static double ms_since(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+Player::Player(const std::vector<std::string> &paths, const PlayerOptions &opts):
+    playlist{paths},
+    options{opts},
+    cache{opts.step_cache},
+    started{std::chrono::steady_clock::now()},
+    policy{opts.drop}
+{
+    // GLFW wants its window on the main thread, the first entry is probed and opened meanwhile
+    auto opening = std::async(std::launch::async, [this]
+    {
+        VPL_TRACE_THREAD("open");
+        auto t = std::chrono::steady_clock::now();
+        auto d = std::make_unique<Decoder>(playlist.front(), decoder_options(options));
+        open_ms = ms_since(t);
+        return d;
+    });
+    rnd = std::make_unique<VPLRender>();
+    rnd->toneMap(opts.tone_map, opts.hdr_peak);
+    window_ms = ms_since(started);
+    dec = opening.get();
+    audio = open_audio(dec.get());
+    pipe = std::make_unique<Pipeline>(dec.get(), audio.get(), opts.drop);
+    updateDuration();
+    traceInit();
+}
+
+void Player::updateDuration()
 {
     int sec = dec->duration() / 1000;
     int hour = sec / 3600;
@@ -47,65 +126,397 @@ Player::Player(const std::string &file_path):
     if(second < 10) ssec = "0" + std::to_string(second);
     else ssec = std::to_string(second);
     video_dur = sh+":"+sm+":"+ssec;
-    frame_per_sec = dec->fps();
+}
+
+void Player::prepareNext()
+{
+    if(current + 1 >= playlist.size()) return;
+    std::string path = playlist[current + 1];
+    AudioPlayer* out = audio.get();
+    PlayerOptions opts = options;
+    next = std::async(std::launch::async, [path, out, opts]
+    {
+        VPL_TRACE_THREAD("playlist open");
+        auto item = std::make_unique<PlaylistItem>();
+        item->dec = Decoder::tryOpen(path, decoder_options(opts));
+        if(!item->dec) return std::unique_ptr<PlaylistItem>{};
+        item->pipe = std::make_unique<Pipeline>(item->dec.get(), out, opts.drop);
+        item->pipe->prime();
+        return item;
+    });
+}
+
+/* Current entry ran out: hand over to the prepared one and take its
+ * first picture. Its timeline starts one frame after the last picture
+ * of the entry before. */
+bool Player::nextEntry(std::unique_ptr<Picture> &pic)
+{
+    double end = offset + last_sec + (dec->fps() > 0.0 ? 1.0 / dec->fps() : 0.0);
+    while(next.valid())
+    {
+        std::unique_ptr<PlaylistItem> item = next.get();
+        if(!item)
+        {
+            std::cerr << "Couldn't open " << playlist[current + 1] << ", skipping it." << "\n";
+            current++;
+            prepareNext();
+            continue;
+        }
+        pipe->finish();
+        printStats();
+        if(!audio && item->dec->hasAudio())
+        {
+            // primed without sound, rebuild it now that there is an output
+            audio = open_audio(item->dec.get());
+            if(audio) item->pipe = std::make_unique<Pipeline>(item->dec.get(), audio.get(), options.drop);
+        }
+        pipe = std::move(item->pipe);
+        dec = std::move(item->dec);
+        stepper.reset();
+        current++;
+        idx = 0;
+        cache.clear();
+        updateDuration();
+        prepareNext();
+
+        if(speed != 1.0)
+        {
+            // primed for 1x, start it over at this speed
+            pipe->setSpeed(speed);
+            pipe->seek(dec->frameToPts(0));
+        }
+        pipe->prime();
+        if(!pipe->nextPicture(pic)) continue;  // nothing to show, on to the one after
+        last_sec = pic->pts * av_q2d(dec->timeBase());
+        offset = end - last_sec;
+        pipe->setTimeOffset(offset);
+        pipe->start();
+        return true;
+    }
+    return false;
+}
+
+void Player::printStats()
+{
+    auto print = [](const char* name, const QueueStats& q)
+    {
+        std::cerr << name << ": depth " << q.depth << "/" << q.capacity << " peak " << q.peak
+                  << ", producer blocked " << q.push_blocked_ms << " ms"
+                  << ", consumer blocked " << q.pop_blocked_ms << " ms" << "\n";
+    };
+    PipelineStats st = pipe->stats();
+    print("demux -> decode  ", st.packets);
+    print("decode -> convert", st.frames);
+    print("convert -> render", st.pictures);
+    std::cerr << "frames: " << presented << " presented, " << late << " late (> " << policy.late_ms << " ms), dropped "
+              << dropped << " before paint and " << st.dropped << " before conversion, " << st.decimated
+              << " left out for speed" << "\n";
+    ReaderStats io = dec->readerStats();
+    std::cerr << "input (" << io.mode << "): " << io.bytes_read / (1024.0 * 1024.0) << " MB read, stalled " << io.stall_ms
+              << " ms, buffered " << io.buffered / 1024 << "/" << io.capacity / 1024 << " KB" << "\n";
+    FrameCacheStats cs = cache.stats();
+    std::cerr << "step cache: " << cs.hits << " hits, " << cs.misses << " misses, " << cs.evictions << " evicted, "
+              << cs.entries << " frames in " << cs.bytes / (1024.0 * 1024.0) << "/" << cs.budget / (1024.0 * 1024.0) << " MB"
+              << "\n";
+    std::cerr << "frame pool: " << st.pool.in_use << " in use, high water " << st.pool.high_water << "/" << st.pool.capacity
+              << " buffers of " << st.pool.buffer_size / (1024.0 * 1024.0) << " MB" << "\n";
+}
+
+/* Into reverse from the picture on screen, or again from idx after a
+ * seek, without sound; out of it the forward pipeline picks up from the
+ * last picture shown backwards. */
+void Player::setReverse(bool on)
+{
+    int64_t from = dec->frameToPts(idx > 0 ? idx - 1 : 0);
+    reverse.reset();
+    if(!on)
+    {
+        pipe->seek(from);
+        return;
+    }
+    pipe->stop();
+    DecoderOptions opts = decoder_options(options);
+    opts.audio = false;
+    opts.index_scan = false;
+    reverse = std::make_unique<ReversePipeline>(playlist[current], opts, from, options.reverse_budget);
+}
+
+void Player::showStill(Picture *pic)
+{
+    shown_pts = pic->pts;
+    last_sec = pic->pts * av_q2d(dec->timeBase());
+    idx = frame_at(dec.get(), last_sec);
+    rnd->paint(pic->planes());
+    glfwSwapBuffers(rnd->window());
+    updateCounter(idx);
+    idx++;
+}
+
+/* One frame forward (dir 1) or back (dir -1) while paused. The cache
+ * answers when it holds the neighbour; otherwise forward comes from the
+ * pipeline, moved next to the picture on screen first if needed, and
+ * back from a ReversePipeline kept around for the next steps. */
+void Player::stepFrame(int dir)
+{
+    if(shown_pts == AV_NOPTS_VALUE) return;
+    if(reverse)
+    {
+        setReverse(false);
+        synced = false;
+    }
+    double fps = dec->fps() > 0.0 ? dec->fps() : 25.0;
+    int64_t gap = static_cast<int64_t>(1.5 / (fps * av_q2d(dec->timeBase())));
+    Picture* hit = dir > 0 ? cache.after(shown_pts, gap) : cache.before(shown_pts, gap);
+    if(hit)
+    {
+        synced = false;
+        showStill(hit);
+        return;
+    }
+
+    std::unique_ptr<Picture> pic;
+    if(dir > 0)
+    {
+        if(!synced) pipe->seek(dec->frameToPts(idx));
+        if(!pipe->nextPicture(pic)) return;
+        synced = true;
+        seeking = false;
+    }
+    else
+    {
+        if(!stepper)
+        {
+            DecoderOptions opts = decoder_options(options);
+            opts.audio = false;
+            opts.index_scan = false;
+            stepper = std::make_unique<ReversePipeline>(playlist[current], opts, shown_pts, options.reverse_budget);
+        }
+        else if(stepper_pts != shown_pts)
+        {
+            stepper->seek(shown_pts);
+        }
+        if(!stepper->nextPicture(pic)) return;
+        stepper_pts = pic->pts;
+        synced = false;
+    }
+    cache.put(*pic);
+    showStill(pic.get());
+}
+
+/* Jumps to frame target. A seek still in flight is dropped: stopping
+ * the pipeline cancels whatever it was decoding on the way there. */
+void Player::seekTo(std::size_t target)
+{
+    idx = target;
+    seek_idx = target;
+    seeking = true;
+    if(reverse) setReverse(true);
+    else pipe->seek(dec->frameToPts(idx), seek_mode);
+}
+
+/* Takes everything the keys queued since the last call. Seeks add up
+ * from the target of the one in flight, if any, so a burst of presses
+ * costs one seek to where they end up. True when playback jumped and
+ * the clock has to restart. */
+bool Player::runCommands()
+{
+    PlayerCommand cmd;
+    bool seek{false}, resync{false}, jumped{false};
+    double seek_by{0.0};
+    double fps = dec->fps() > 0.0 ? dec->fps() : 25.0;
+    while(commands.read(&cmd, 1) == 1)
+    {
+        switch(cmd.type)
+        {
+        case CommandType::Seek:
+            seek = true;
+            seek_by += cmd.value;
+            break;
+        case CommandType::Step:
+            stepFrame(cmd.value > 0.0 ? 1 : -1);
+            break;
+        case CommandType::Speed:
+            if(cmd.value == speed) break;
+            // carry on from the picture on screen at the new rate
+            speed = cmd.value;
+            pipe->setSpeed(speed);
+            updateCounter(counter_id);
+            resync = !reverse;
+            jumped = true;
+            break;
+        case CommandType::SeekMode:
+            seek_mode = seek_mode == SeekMode::Exact ? SeekMode::Fast :
+                        seek_mode == SeekMode::Fast ? SeekMode::Snap : SeekMode::Exact;
+            updateCounter(counter_id);
+            break;
+        case CommandType::Reverse:
+            setReverse(!reverse);
+            updateCounter(counter_id);
+            jumped = true;
+            break;
+        }
+    }
+    if(!seek)
+    {
+        if(resync) pipe->seek(dec->frameToPts(seeking ? seek_idx : idx.load()));
+        return jumped;
+    }
+    double to = static_cast<double>(seeking ? seek_idx : idx.load()) + seek_by * fps;
+    seekTo(to > 0.0 ? static_cast<std::size_t>(to) : 0);
+    return true;
+}
+
+/* Waits for the first picture after a seek without going deaf to
+ * input. False when a newer command, a pause or a close came first. */
+bool Player::waitSeek()
+{
+    while(!(reverse ? reverse->pictureReady(seek_poll_ms) : pipe->pictureReady(seek_poll_ms)))
+    {
+        glfwPollEvents();
+        if(commands.readable() > 0 || b_pause_play || glfwWindowShouldClose(rnd->window())) return false;
+    }
+    return true;
+}
+
+// time to first frame, from the Player starting up to the first picture on screen
+void Player::printFirstFrame()
+{
+    std::cerr << "first frame after " << ms_since(started) << " ms (window " << window_ms << " ms, open " << open_ms
+              << " ms" << (dec->infoCached() ? " with cached probe size" : "") << ")" << "\n";
+}
+
+/* Presentation clock in wall seconds, timeline seconds divided by the
+ * speed. GLFW time keeps it running, and while sound plays (only at 1x)
+ * it is slaved to the audio clock: small drift is slewed away a tenth
+ * at a time, jumps (seek, audio start) are snapped. */
+double Player::clock()
+{
+    double now = glfwGetTime();
+    double a;
+    if(audio && audio->clock(&a))
+    {
+        double diff = a / speed - now;
+        if(std::fabs(diff) > 0.1) now += diff;
+        else now += diff * 0.1;
+        glfwSetTime(now);
+    }
+    return now;
 }
 
 void Player::operator()()
 {
-    std::vector<unsigned char> pic(dec->width()*dec->height()*4);
-    int64_t ts;
-    int eof{0};
+    std::unique_ptr<Picture> pic;
+    bool first{true};
+    int drop_run{0};
+    VPL_TRACE_THREAD("render");
+    pipe->start();
+    prepareNext();
     while(!glfwWindowShouldClose(rnd->window()))
     {
         glfwPollEvents();
-        if(b_seekable)
-        {
-            int64_t one_f = dec->timeBase().den / dec->fps();
-            int64_t seek_ts = idx * one_f;
-            dec->seek(seek_ts);
-            if(!dec->readSeekFrameFromDecoder(seek_ts, &pic[0], &ts, &eof))
-            {
-                if(eof == 1) break;
-                std::cerr << "Couldn't find seeking frame." <<"\n";
-                break;
-            }
-            rnd->paint(pic.data(), dec->width(), dec->height());
-            glfwSwapBuffers(rnd->window());
-            double nt = ts * (double)dec->timeBase().num / (double)dec->timeBase().den;
-            glfwSetTime(nt);
-            b_seekable = false;
-        }
+        traceDump(false);
+        if(runCommands()) first = true;
         if(b_pause_play)
         {
             double oldt = glfwGetTime();
-            while(b_pause_play)
+            if(audio) audio->pause(true);
+            // asleep until a key or the window needs something, the stages wait on their full queues
+            while(b_pause_play && !glfwWindowShouldClose(rnd->window()))
             {
-                glfwPollEvents();
+                glfwWaitEvents();
+                if(commands.readable() > 0)
+                {
+                    if(runCommands()) first = true;
+                    b_redraw = false;
+                }
+                if(b_redraw.exchange(false))
+                {
+                    rnd->redraw();
+                    glfwSwapBuffers(rnd->window());
+                }
             }
+            if(audio) audio->pause(false);
             glfwSetTime(oldt);
+            if(stepper)
+            {
+                // playing on, keep its Decoder for the next pause but not its pictures
+                stepper->release();
+                stepper_pts = AV_NOPTS_VALUE;
+            }
+            if(!synced && !reverse)
+            {
+                // stepped away from the pipeline, go on from the picture on screen
+                pipe->seek(dec->frameToPts(idx));
+                first = true;
+            }
         }
-        if(!dec->readFrameFromDecoder(&pic[0], &ts, &eof))
+        if(seeking && !waitSeek()) continue;
+        if(reverse && !reverse->nextPicture(pic))
         {
-            if(eof == 1) break;
-            std::cerr << "Couldn't load video frame." <<"\n";
-            break;
+            // back at the start, wait there
+            setReverse(false);
+            b_pause_play = true;
+            continue;
         }
+        if(!reverse && !pipe->nextPicture(pic) && !nextEntry(pic)) break;
+        seeking = false;
+        idx += pic->skipped;
 
-        static bool first = true;
+        last_sec = pic->pts * (double)dec->timeBase().num / (double)dec->timeBase().den;
+        // frames the decoder skipped at speed were never counted, the timestamp tells where we are
+        if(speed != 1.0 || reverse) idx = frame_at(dec.get(), last_sec);
+        // backwards the clock runs up from the first picture shown while the timestamps run down
+        if(first && reverse) reverse_start = last_sec;
+        double sec = (reverse ? reverse_start - last_sec : last_sec + offset) / speed;
         if(first)
         {
-            glfwSetTime(0.0);
+            glfwSetTime(sec);
             first = false;
         }
 
-        double sec = (ts * (double)dec->timeBase().num / (double)dec->timeBase().den) * speed;
-        while(sec > glfwGetTime())
+        double now;
+        while(sec > (now = clock()))
+        {
+            glfwWaitEventsTimeout(sec - now);
+        }
+        if(!reverse)
+        {
+            pipe->presentClock(now * speed - offset);
+            // follows resizes and fullscreen, pictures converted from here on are no larger than shown
+            int fit_w, fit_h;
+            rnd->fitSize(dec->width(), dec->height(), &fit_w, &fit_h);
+            pipe->outputSize(fit_w, fit_h);
+        }
+
+        // behind the clock: count it, and skip the upload when it's too late to be worth showing
+        double behind = (now - sec) * 1000.0;
+        if(behind > policy.late_ms) late++;
+        if(policy.present_drop_ms > 0.0 && behind > policy.present_drop_ms && drop_run < policy.max_consecutive)
         {
-            glfwWaitEventsTimeout(sec - glfwGetTime());
+            drop_run++;
+            dropped++;
+            pic.reset();
+            idx++;
+            continue;
+        }
+        drop_run = 0;
+        presented++;
+        rnd->paint(pic->planes());
+        cache.put(*pic);
+        shown_pts = pic->pts;
+        synced = !reverse;
+        pic.reset();
+        {
+            VPL_TRACE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(rnd->window());
         }
-        rnd->paint(pic.data(), dec->width(), dec->height());
-        glfwSwapBuffers(rnd->window());
+        if(presented == 1 && current == 0) printFirstFrame();
         updateCounter(idx);
         idx++;
     }
+    stepper.reset();
+    reverse.reset();
+    pipe->stop();
+    printStats();
+    traceDump(true);
 }
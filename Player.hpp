@@ -1,18 +1,88 @@
 #pragma once
 #include "window/VPLRender.hpp"
 #include "ffmpeg/Decoder.hpp"
+#include "Pipeline.hpp"
+#include "ReversePipeline.hpp"
+#include "FrameCache.hpp"
+#include "Commands.hpp"
 #include <memory>
+#include <vector>
+#include <future>
+#include <chrono>
 
+struct PlayerOptions
+{
+    DropPolicy drop;
+    ReadMode read_mode{ReadMode::Auto};
+    std::size_t read_ahead{16 << 20};
+    ProbeOptions probe;
+    std::size_t reverse_budget{512 << 20};  // decoded frames held for reverse playback
+    std::size_t step_cache{512 << 20};      // presented frames kept for stepping back
+    int lowres{0};                          // decode at 1/2^lowres size where the codec can
+    bool tone_map{true};                    // PQ/HLG to SDR in the shader
+    double hdr_peak{1000.0};                // nits mapped to full white
+};
+
+// a playlist entry opened ahead of time, pipe declared last so it goes first
+struct PlaylistItem
+{
+    std::unique_ptr<Decoder> dec;
+    std::unique_ptr<Pipeline> pipe;
+};
+
+/* Plays the playlist entries back to back in one window. While an
+ * entry plays the next one is opened and its video stages primed on a
+ * background thread; at the switch its audio is queued behind what is
+ * still playing and both are shifted onto one continuous timeline, so
+ * neither picture nor sound has a gap. */
 class Player
 {
 private:
     std::unique_ptr<VPLRender> rnd;
+    std::vector<std::string> playlist;
+    std::size_t current{0};
+    PlayerOptions options;
     std::unique_ptr<Decoder> dec;
+    std::unique_ptr<AudioPlayer> audio;
+    std::unique_ptr<Pipeline> pipe;
+    std::future<std::unique_ptr<PlaylistItem>> next;
+    std::unique_ptr<ReversePipeline> reverse;
+    double reverse_start{0.0};  // stream seconds of the first picture shown backwards
+    FrameCache cache;
+    std::unique_ptr<ReversePipeline> stepper;  // decodes backwards for steps the cache misses
+    int64_t stepper_pts{AV_NOPTS_VALUE};       // last picture it gave
+    int64_t shown_pts{AV_NOPTS_VALUE};
+    bool synced{true};        // the pipeline goes on right after the picture on screen
+    bool seeking{false};      // a seek whose first picture hasn't come yet
+    std::size_t seek_idx{0};  // and the frame it goes to
+    std::chrono::steady_clock::time_point started;
+    double window_ms{0.0};   // creating the window, the first entry opens meanwhile
+    double open_ms{0.0};     // opening the first entry
     std::string video_dur;
+    int counter_id{0};       // what the title shows, set again on a change of speed, direction or seek mode
     double speed{1.0};
+    SeekMode seek_mode{SeekMode::Exact};
+    double offset{0.0};      // timeline seconds of the current entry's stream time 0
+    double last_sec{0.0};    // stream seconds of the last picture taken from the current entry
+    DropPolicy policy;
+    uint64_t presented{0};
+    uint64_t late{0};
+    uint64_t dropped{0};
     void updateCounter(int id);
+    void updateDuration();
+    void printStats();
+    void printFirstFrame();
+    double clock();
+    void prepareNext();
+    void setReverse(bool on);
+    void stepFrame(int dir);
+    void seekTo(std::size_t target);
+    bool runCommands();
+    bool waitSeek();
+    void showStill(Picture* pic);
+    bool nextEntry(std::unique_ptr<Picture>& pic);
 public:
-    Player(const std::string& file_path);
+    Player(const std::vector<std::string>& paths, const PlayerOptions& opts = PlayerOptions{});
     ~Player() = default;
     void operator()();
 };
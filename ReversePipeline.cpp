@@ -0,0 +1,176 @@
+#include "ReversePipeline.hpp"
+#include "utils/Trace.hpp"
+#include <algorithm>
+
+static const std::size_t min_window{2};
+static const std::size_t max_window{120};
+
+ReversePipeline::ReversePipeline(const std::string &path, const DecoderOptions &opts, int64_t from_pts, std::size_t budget):
+    dec_{std::make_unique<Decoder>(path, opts)},
+    from_{from_pts},
+    runs_{1}
+{
+    // RGB0 is the most a picture takes, either as decoded or converted
+    frame_bytes_ = std::max(av_image_get_buffer_size(AV_PIX_FMT_RGB0, dec_->width(), dec_->height(), 64), 1);
+    // one run on screen, one queued and one being decoded
+    window_ = std::min(std::max(budget / (3 * frame_bytes_), min_window), max_window);
+    pool_ = std::make_unique<FramePool>(frame_bytes_, 3 * window_);
+    worker_ = std::thread(&ReversePipeline::run, this);
+}
+
+ReversePipeline::~ReversePipeline()
+{
+    stop();
+}
+
+void ReversePipeline::stop()
+{
+    stop_ = true;
+    runs_.abort();
+    pool_->abort();
+    if(worker_.joinable()) worker_.join();
+}
+
+/* Starts over from from_pts with the same Decoder, which saves the
+ * probe, codec open and threads a new pipeline would set up again. */
+void ReversePipeline::seek(int64_t from_pts)
+{
+    stop();
+    // pictures hold pool frames, let them go before the pool is reset
+    current_.reset();
+    runs_.clear();
+    runs_.reset();
+    pool_->reset();
+    stop_ = false;
+    from_ = from_pts;
+    worker_ = std::thread(&ReversePipeline::run, this);
+}
+
+// stops decoding and gives back the memory of the window, the Decoder stays open for seek()
+void ReversePipeline::release()
+{
+    stop();
+    current_.reset();
+    runs_.clear();
+    pool_ = std::make_unique<FramePool>(frame_bytes_, 3 * window_);
+}
+
+bool ReversePipeline::nextPicture(std::unique_ptr<Picture> &pic)
+{
+    while(!current_ || current_->empty())
+    {
+        if(!runs_.pop(current_) || !current_) return false;
+    }
+    pic = std::move(current_->back());
+    current_->pop_back();
+    return true;
+}
+
+// nextPicture() won't block, or wait_ms passed
+bool ReversePipeline::pictureReady(int wait_ms)
+{
+    if(current_ && !current_->empty()) return true;
+    return runs_.waitFor(std::chrono::milliseconds(wait_ms));
+}
+
+/* Decodes from the keyframe at or before seek_ts up to to, keeping the
+ * last window_ frames before it in kept. key is the first frame out of
+ * the decoder. False when decoding fails or the pipeline stops. */
+bool ReversePipeline::decodeRun(int64_t seek_ts, int64_t to, std::deque<std::unique_ptr<Frame>> &kept, int64_t *key)
+{
+    VPL_TRACE_SCOPE("ReversePipeline::decodeRun");
+    dec_->seek(seek_ts);
+    *key = AV_NOPTS_VALUE;
+    Packet pkt;
+    int eof{0};
+    auto f = std::make_unique<Frame>();
+    while(!stop_)
+    {
+        if(dec_->receiveFrame(f.get()))
+        {
+            int64_t ts = f->timeStamp();
+            if(ts == AV_NOPTS_VALUE) continue;
+            if(*key == AV_NOPTS_VALUE) *key = ts;
+            if(ts >= to) return true;
+            kept.push_back(std::move(f));
+            if(kept.size() > window_)
+            {
+                // the oldest one falls out of the window, its Frame takes the next one
+                f = std::move(kept.front());
+                kept.pop_front();
+            }
+            else
+            {
+                f = std::make_unique<Frame>();
+            }
+            continue;
+        }
+        if(eof == 1) return true;
+        if(!dec_->readPacket(&pkt))
+        {
+            dec_->sendPacket(nullptr, &eof);
+            continue;
+        }
+        bool sent = dec_->sendPacket(&pkt, &eof);
+        pkt.unref();
+        if(!sent) return false;
+    }
+    return false;
+}
+
+std::unique_ptr<Picture> ReversePipeline::picture(std::unique_ptr<Frame> f)
+{
+    auto pic = std::make_unique<Picture>();
+    pic->pts = f->timeStamp();
+    PixelLayout layout;
+    if(shaderLayout(f->format(), &layout))
+    {
+        pic->frame = std::move(f);
+        return pic;
+    }
+    pic->frame = std::make_unique<Frame>();
+    if(!pic->frame->allocate(pool_.get(), dec_->width(), dec_->height(), AV_PIX_FMT_RGB0)) return nullptr;
+    if(!dec_->convertFrame(f.get(), pic->frame.get()))
+    {
+        std::cerr << "Couldn't convert video frame." << "\n";
+        return nullptr;
+    }
+    return pic;
+}
+
+void ReversePipeline::run()
+{
+    VPL_TRACE_THREAD("reverse decode");
+    int64_t start = dec_->startTime() != AV_NOPTS_VALUE ? dec_->startTime() : 0;
+    int64_t step = av_rescale_q(1, AVRational{1, 1}, dec_->timeBase());
+    int64_t to = from_;
+    int64_t seek_ts = from_ - 1;
+    std::deque<std::unique_ptr<Frame>> kept;
+    while(!stop_ && to > start)
+    {
+        int64_t key;
+        if(!decodeRun(seek_ts, to, kept, &key)) break;
+        if(kept.empty())
+        {
+            // the seek landed at or past to, look further back
+            if(seek_ts <= start) break;
+            seek_ts -= step;
+            continue;
+        }
+        int64_t first = kept.front()->timeStamp();
+        auto run = std::make_unique<PictureRun>();
+        for(auto& f : kept)
+        {
+            auto pic = picture(std::move(f));
+            if(!pic) break;
+            run->push_back(std::move(pic));
+        }
+        kept.clear();
+        if(!runs_.push(std::move(run))) return;
+
+        // the keyframe was kept: the GOP before is next, otherwise what's left of this one
+        to = first;
+        if(first <= key) seek_ts = first - 1;
+    }
+    runs_.push(nullptr);
+}
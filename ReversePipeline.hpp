@@ -0,0 +1,41 @@
+#pragma once
+#include "Pipeline.hpp"
+#include <deque>
+
+// pictures of one decode pass, ascending
+using PictureRun = std::vector<std::unique_ptr<Picture>>;
+
+/* Plays one file backwards from a timestamp. A worker thread with its
+ * own Decoder seeks to the keyframe before what is left to show,
+ * decodes forward and keeps the last frames before that point, at most
+ * a third of the memory budget; a GOP longer than that is covered in
+ * several passes from its keyframe. While the presenter walks one run
+ * backwards the worker decodes the run before it. Frames pushed out of
+ * the window are reused for the next decode and converted pictures come
+ * from a FramePool, so memory stays at the budget whatever the GOP. */
+class ReversePipeline
+{
+private:
+    std::unique_ptr<Decoder> dec_;
+    std::size_t window_;
+    std::size_t frame_bytes_;
+    int64_t from_;
+    // declared before the queue so it outlives any picture left in it
+    std::unique_ptr<FramePool> pool_;
+    BoundedQueue<std::unique_ptr<PictureRun>> runs_;
+    std::unique_ptr<PictureRun> current_;
+    std::atomic<bool> stop_{false};
+    std::thread worker_;
+    bool decodeRun(int64_t seek_ts, int64_t to, std::deque<std::unique_ptr<Frame>>& kept, int64_t* key);
+    std::unique_ptr<Picture> picture(std::unique_ptr<Frame> f);
+    void run();
+    void stop();
+public:
+    // shows the frames before from_pts, newest first
+    ReversePipeline(const std::string& path, const DecoderOptions& opts, int64_t from_pts, std::size_t budget);
+    ~ReversePipeline();
+    void seek(int64_t from_pts);
+    void release();
+    bool nextPicture(std::unique_ptr<Picture>& pic);
+    bool pictureReady(int wait_ms);
+};
@@ -0,0 +1,190 @@
+#include "AudioPlayer.hpp"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+AudioPlayer::AudioPlayer(int rate, int channels):
+    rate_{rate},
+    channels_{channels},
+    samples_{static_cast<std::size_t>(rate) * channels},
+    marks_{256}
+{
+    PaError err = Pa_Initialize();
+    if(err != paNoError)
+    {
+        std::cerr << "Couldn't initialize PortAudio: " << Pa_GetErrorText(err) << "\n";
+        return;
+    }
+    pa_init_ = true;
+    err = Pa_OpenDefaultStream(&stream_, 0, channels_, paFloat32, rate_, paFramesPerBufferUnspecified, &AudioPlayer::callback,
+                               this);
+    if(err != paNoError)
+    {
+        std::cerr << "Couldn't open audio output: " << Pa_GetErrorText(err) << "\n";
+        stream_ = nullptr;
+        return;
+    }
+    if(const PaStreamInfo* info = Pa_GetStreamInfo(stream_)) latency_ = info->outputLatency;
+    err = Pa_StartStream(stream_);
+    if(err != paNoError)
+    {
+        std::cerr << "Couldn't start audio output: " << Pa_GetErrorText(err) << "\n";
+        Pa_CloseStream(stream_);
+        stream_ = nullptr;
+    }
+}
+
+AudioPlayer::~AudioPlayer()
+{
+    if(stream_)
+    {
+        Pa_StopStream(stream_);
+        Pa_CloseStream(stream_);
+        stream_ = nullptr;
+    }
+    if(pa_init_) Pa_Terminate();
+}
+
+bool AudioPlayer::ok()
+{
+    return stream_ != nullptr;
+}
+
+int AudioPlayer::callback(const void *input, void *output, unsigned long frames, const PaStreamCallbackTimeInfo *time,
+                          PaStreamCallbackFlags flags, void *user)
+{
+    static_cast<AudioPlayer*>(user)->fill(static_cast<float*>(output), frames, time);
+    return paContinue;
+}
+
+void AudioPlayer::fill(float *out, unsigned long frames, const PaStreamCallbackTimeInfo *time)
+{
+    if(flush_req_.load(std::memory_order_acquire) != flush_ack_.load(std::memory_order_relaxed))
+    {
+        discard();
+        flush_ack_.store(flush_req_.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    std::size_t want = frames * channels_;
+    std::size_t have = std::min(frames, static_cast<unsigned long>(samples_.readable() / channels_));
+    if(paused_.load(std::memory_order_relaxed) || have == 0)
+    {
+        // paused or starved: play silence and keep the samples for later, the clock stops
+        std::memset(out, 0, want * sizeof(float));
+        publish(0.0, 0.0, false);
+        return;
+    }
+
+    while(const AudioMark* m = marks_.front())
+    {
+        if(m->frame > read_) break;
+        base_ = *m;
+        has_base_ = true;
+        marks_.pop();
+    }
+    double pts = base_.pts + static_cast<double>(read_ - base_.frame) / rate_;
+    // short of a full buffer: play what is there and pad with silence rather than holding it back
+    std::size_t got = samples_.read(out, have * channels_);
+    std::memset(out + got, 0, (want - got) * sizeof(float));
+    read_ += got / channels_;
+
+    double dac = time->outputBufferDacTime > 0.0 ? time->outputBufferDacTime : time->currentTime + latency_;
+    publish(pts, dac, has_base_);
+}
+
+void AudioPlayer::discard()
+{
+    read_ += samples_.discard() / channels_;
+    marks_.discard();
+    has_base_ = false;
+}
+
+void AudioPlayer::publish(double pts, double time, bool valid)
+{
+    // seqlock, the callback is the only writer and never waits
+    seq_.fetch_add(1, std::memory_order_acq_rel);
+    clock_pts_.store(pts, std::memory_order_relaxed);
+    clock_time_.store(time, std::memory_order_relaxed);
+    clock_valid_.store(valid, std::memory_order_relaxed);
+    seq_.fetch_add(1, std::memory_order_release);
+}
+
+bool AudioPlayer::write(const float *data, int frames, double pts)
+{
+    marks_.push(AudioMark{written_, pts});
+    std::size_t total = static_cast<std::size_t>(frames) * channels_;
+    std::size_t done{0};
+    while(done < total)
+    {
+        if(interrupted_.load(std::memory_order_relaxed)) return false;
+        std::size_t room = samples_.writable() / channels_ * channels_;
+        done += samples_.write(data + done, std::min(room, total - done));
+        if(done < total && paused_.load(std::memory_order_relaxed))
+        {
+            std::unique_lock<std::mutex> lk(park_mutex_);
+            park_.wait(lk, [this]{ return !paused_ || interrupted_; });
+        }
+        else if(done < total) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    written_ += frames;
+    return true;
+}
+
+void AudioPlayer::interrupt(bool on)
+{
+    {
+        std::lock_guard<std::mutex> lk(park_mutex_);
+        interrupted_ = on;
+    }
+    park_.notify_all();
+}
+
+/* Drops everything buffered. Must only be called while no write() is
+ * running; the callback does the actual discard so the ring keeps a
+ * single consumer, and then finds itself starved and marks the clock
+ * invalid in the same pass. */
+void AudioPlayer::flush()
+{
+    unsigned req = flush_req_.fetch_add(1) + 1;
+    for(int i{0}; i < 200 && flush_ack_.load(std::memory_order_acquire) != req; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if(flush_ack_.load(std::memory_order_acquire) != req)
+    {
+        // callback isn't running, nothing races with us
+        discard();
+        publish(0.0, 0.0, false);
+        flush_ack_.store(req, std::memory_order_release);
+    }
+    written_ = read_;
+}
+
+void AudioPlayer::pause(bool on)
+{
+    {
+        std::lock_guard<std::mutex> lk(park_mutex_);
+        paused_ = on;
+    }
+    park_.notify_all();
+}
+
+bool AudioPlayer::clock(double *sec)
+{
+    if(!stream_) return false;
+    unsigned s1, s2;
+    double pts, time;
+    bool valid;
+    do
+    {
+        s1 = seq_.load(std::memory_order_acquire);
+        pts = clock_pts_.load(std::memory_order_relaxed);
+        time = clock_time_.load(std::memory_order_relaxed);
+        valid = clock_valid_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s2 = seq_.load(std::memory_order_relaxed);
+    } while((s1 & 1) || s1 != s2);
+    if(!valid) return false;
+    *sec = pts + (Pa_GetStreamTime(stream_) - time);
+    return true;
+}
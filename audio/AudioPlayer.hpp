@@ -0,0 +1,60 @@
+#pragma once
+#include "../utils/SpscRing.hpp"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <portaudio.h>
+
+struct AudioMark
+{
+    int64_t frame{0};  // producer frame position where this pts starts
+    double pts{0.0};
+};
+
+/* Interleaved float output through the default PortAudio device.
+ * The decode thread write()s samples into a lock free ring that the
+ * PortAudio callback drains; the callback never locks or allocates.
+ * The callback also publishes which pts reaches the DAC and when, so
+ * clock() can serve as the master clock for video presentation.
+ * While paused a write() that finds the ring full sleeps until
+ * resumed or interrupted. */
+class AudioPlayer
+{
+private:
+    PaStream* stream_{nullptr};
+    bool pa_init_{false};      // Pa_Terminate only balances a successful Pa_Initialize
+    int rate_;
+    int channels_;
+    double latency_{0.0};
+    SpscRing<float> samples_;
+    SpscRing<AudioMark> marks_;
+    int64_t written_{0};       // producer side frame count
+    int64_t read_{0};          // callback side frame count
+    AudioMark base_;           // callback side, last mark passed
+    bool has_base_{false};
+    std::atomic<bool> paused_{false};
+    std::atomic<bool> interrupted_{false};
+    std::atomic<unsigned> flush_req_{0};
+    std::atomic<unsigned> flush_ack_{0};
+    std::atomic<unsigned> seq_{0};
+    std::atomic<double> clock_pts_{0.0};
+    std::atomic<double> clock_time_{0.0};
+    std::atomic<bool> clock_valid_{false};
+    std::mutex park_mutex_;
+    std::condition_variable park_;
+    static int callback(const void* input, void* output, unsigned long frames, const PaStreamCallbackTimeInfo* time,
+                        PaStreamCallbackFlags flags, void* user);
+    void fill(float* out, unsigned long frames, const PaStreamCallbackTimeInfo* time);
+    void discard();
+    void publish(double pts, double time, bool valid);
+public:
+    AudioPlayer(int rate, int channels);
+    ~AudioPlayer();
+    bool ok();
+    bool write(const float* data, int frames, double pts);
+    void interrupt(bool on);
+    void flush();
+    void pause(bool on);
+    bool clock(double* sec);
+};
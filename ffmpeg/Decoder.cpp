@@ -1,4 +1,10 @@
 #include "Decoder.hpp"
+#include "KeyframeIndex.hpp"
+#include "../utils/Trace.hpp"
+#include "../utils/YuvToRgb.hpp"
+#include "../utils/ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
 #define EXIT std::exit(EXIT_FAILURE)
 
 static std::string ffmpeg_error_string(const int errnum)
@@ -8,49 +14,211 @@ static std::string ffmpeg_error_string(const int errnum)
     return std::string(emsg);
 }
 
-Decoder::Decoder(const std::string &file_path):
-    fmt{std::make_unique<FormatContext>(file_path)},
-    ctx{std::make_unique<CodecContext>(fmt->video_ID())},
-    pkt{std::make_unique<Packet>()},
-    frame{std::make_unique<Frame>()},
-    si{std::make_unique<scale_image>(ctx.get())}
-{}
+Decoder::Decoder(const std::string &file_path, const DecoderOptions &opts)
+{
+    if(!init(file_path, opts)) EXIT;
+}
 
-bool Decoder::readFrameFromDecoder(unsigned char *frame_buffer, int64_t *pts, int* eof)
+// nullptr instead of exiting when the file can't be opened or its video not decoded
+std::unique_ptr<Decoder> Decoder::tryOpen(const std::string &file_path, const DecoderOptions &opts)
+{
+    std::unique_ptr<Decoder> d{new Decoder};
+    if(!d->init(file_path, opts)) return nullptr;
+    return d;
+}
+
+bool Decoder::init(const std::string &file_path, const DecoderOptions &opts)
+{
+    fmt = FormatContext::tryOpen(file_path, opts.read_mode, opts.read_ahead, opts.probe);
+    if(!fmt) return false;
+    if(!fmt->video_ID())
+    {
+        std::cerr << "Couldn't find a video stream in " << file_path << "\n";
+        return false;
+    }
+    ctx = CodecContext::tryOpen(fmt->video_ID(), opts.threads, opts.lowres);
+    if(!ctx) return false;
+    pkt = std::make_unique<Packet>();
+    frame = std::make_unique<Frame>();
+    si = std::make_unique<scale_image>(ctx.get());
+    index = std::make_unique<KeyframeIndex>(file_path, fmt->video_ID()->index, opts.index_scan);
+
+    AVStream* as = fmt->audioID();
+    if(!opts.audio || !as) return true;
+    if(!avcodec_find_decoder(as->codecpar->codec_id))
+    {
+        std::cerr << "Couldn't find audio decoder, playing without sound." << "\n";
+        return true;
+    }
+    actx = CodecContext::tryOpen(as);
+    if(!actx)
+    {
+        std::cerr << "Playing without sound." << "\n";
+        return true;
+    }
+    sr = std::make_unique<resample_audio>(actx.get(), 48000, 2);
+    if(!sr->ok())
+    {
+        sr.reset();
+        actx.reset();
+    }
+    return true;
+}
+
+Decoder::~Decoder() = default;
+
+/* Next decoded video frame into the internal frame. Packets are only
+ * read once the decoder has nothing left, and at end of file the
+ * decoder is drained before returning false with eof set. */
+bool Decoder::decodeNextFrame(int *eof)
 {
     while(true)
     {
-        if(!pkt->getPacket(fmt.get())) return false;
-        if(!pkt->is_Stream(fmt->video_ID()->index))
+        if(frame->receive(ctx.get(), nullptr)) return true;
+        if(*eof == 1) return false;
+        if(!readPacket(pkt.get()))
+        {
+            sendPacket(nullptr, eof);
+            continue;
+        }
+        if(isAudio(pkt.get()))
         {
             pkt->unref();
             continue;
         }
-        if(!pkt->send(ctx.get(), eof)) return false;
-        if(!frame->receive(ctx.get(), pkt.get())) continue;
-        break;
+        bool sent = pkt->send(ctx.get(), eof);
+        pkt->unref();
+        if(!sent) return false;
     }
+}
+
+bool Decoder::readFrameFromDecoder(unsigned char *frame_buffer, int64_t *pts, int* eof)
+{
+    if(!decodeNextFrame(eof)) return false;
     *pts = frame->timeStamp();
     return si->getDataFromFrame(frame.get(), frame_buffer);
 }
 
+bool Decoder::readFrameFromDecoder(int64_t *pts, int *eof)
+{
+    if(!decodeNextFrame(eof)) return false;
+    *pts = frame->timeStamp();
+    return true;
+}
+
 bool Decoder::readSeekFrameFromDecoder(int64_t pts, unsigned char *frame_buffer, int64_t *_ts, int *eof)
 {
     seek(pts);
+    *eof = 0;
+    do
+    {
+        if(!decodeNextFrame(eof)) return false;
+    } while(frame->timeStamp() < pts);
+    *_ts = frame->timeStamp();
+    return si->getDataFromFrame(frame.get(), frame_buffer);
+}
+
+bool Decoder::readPacket(Packet *p)
+{
     while(true)
     {
-        if(!pkt->getPacket(fmt.get())) return false;
-        if(!pkt->is_Stream(fmt->video_ID()->index))
+        if(!p->getPacket(fmt.get())) return false;
+        bytes_read += p->size();
+        if(p->is_Stream(fmt->video_ID()->index))
         {
-            pkt->unref();
-            continue;
+            if(p->isKey()) index->add(p->timeStamp(), p->position());
+            return true;
         }
-        if(!pkt->send(ctx.get(), eof)) return false;
-        if(!frame->receive(ctx.get(), pkt.get())) continue;
-        if(frame->timeStamp() >= pts) break;
+        if(isAudio(p)) return true;
+        p->unref();
     }
-    *_ts = frame->timeStamp();
-    return si->getDataFromFrame(frame.get(), frame_buffer);
+}
+
+bool Decoder::sendPacket(Packet *p, int *eof)
+{
+    if(!p)
+    {
+        avcodec_send_packet(ctx->self(), nullptr);
+        *eof = 1;
+        return true;
+    }
+    return p->send(ctx.get(), eof);
+}
+
+bool Decoder::receiveFrame(Frame *f)
+{
+    return f->receive(ctx.get(), nullptr);
+}
+
+bool Decoder::convertFrame(Frame *f, Frame *dst)
+{
+    return si->getDataFromFrame(f, dst);
+}
+
+bool Decoder::hasAudio()
+{
+    return actx != nullptr;
+}
+
+bool Decoder::isAudio(Packet *p)
+{
+    return actx && p && p->is_Stream(fmt->audioID()->index);
+}
+
+bool Decoder::sendAudioPacket(Packet *p, int *eof)
+{
+    if(!p)
+    {
+        avcodec_send_packet(actx->self(), nullptr);
+        *eof = 1;
+        return true;
+    }
+    return p->send(actx.get(), eof);
+}
+
+bool Decoder::receiveAudioFrame(Frame *f)
+{
+    return f->receive(actx.get(), nullptr);
+}
+
+int Decoder::convertAudio(Frame *f, std::vector<float> &out)
+{
+    return sr->convert(f, out);
+}
+
+AVRational Decoder::audioTimeBase()
+{
+    return fmt->audioTimeBase();
+}
+
+int Decoder::audioRate()
+{
+    return sr ? sr->rate() : 0;
+}
+
+int Decoder::audioChannels()
+{
+    return sr ? sr->channels() : 0;
+}
+
+int64_t Decoder::bytesRead()
+{
+    return bytes_read;
+}
+
+ReaderStats Decoder::readerStats()
+{
+    return fmt->readerStats();
+}
+
+bool Decoder::infoCached()
+{
+    return fmt->infoCached();
+}
+
+std::string Decoder::codecName()
+{
+    return ctx->codecName();
 }
 
 int Decoder::width()
@@ -78,10 +246,32 @@ AVRational Decoder::timeBase()
     return fmt->videoTimeBase();
 }
 
-void Decoder::seek(int64_t ts)
+int64_t Decoder::seek(int64_t ts)
 {
+    // landing exactly on an indexed keyframe keeps the forward decode to the target minimal,
+    // until the index is complete ffmpeg finds the keyframe before ts itself
+    KeyframeEntry kf;
+    if(index->findKnown(ts, &kf)) ts = kf.pts;
     avcodec_flush_buffers(ctx->self());
+    if(actx) avcodec_flush_buffers(actx->self());
     av_seek_frame(fmt->self(), fmt->video_ID()->index, ts, AVSEEK_FLAG_BACKWARD);
+    return ts;
+}
+
+void Decoder::fastDecode(bool on)
+{
+    // nothing references a non reference frame, so skipping it never alters a frame that is shown later
+    AVDiscard level = on ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    AVCodecContext* c = ctx->self();
+    c->skip_frame = level;
+    c->skip_loop_filter = level;
+    c->skip_idct = level;
+}
+
+// every decoded frame is then the keyframe at or before where the last seek landed
+void Decoder::keyframesOnly(bool on)
+{
+    ctx->self()->skip_frame = on ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
 }
 
 int64_t Decoder::startTime()
@@ -89,28 +279,125 @@ int64_t Decoder::startTime()
     return fmt->video_ID()->start_time;
 }
 
-FormatContext::FormatContext(const std::string &fpath)
+int64_t Decoder::frameToPts(int64_t frame)
 {
-    fmt_ = avformat_alloc_context();
-    int ret = avformat_open_input(&fmt_, fpath.c_str(), nullptr, nullptr);
-    if(ret != 0)
+    AVRational frame_dur = av_inv_q(fmt->frameRate());
+    KeyframeEntry kf;
+    if(index->findFrame(frame, &kf))
+        return kf.pts + av_rescale_q(frame - kf.frame, frame_dur, timeBase());
+    int64_t start = startTime() != AV_NOPTS_VALUE ? startTime() : 0;
+    return start + av_rescale_q(frame, frame_dur, timeBase());
+}
+
+KeyframeIndex *Decoder::keyframes()
+{
+    return index.get();
+}
+
+static int avio_read(void* opaque, uint8_t* buf, int size)
+{
+    return static_cast<FileReader*>(opaque)->read(buf, size);
+}
+
+static int64_t avio_seek(void* opaque, int64_t offset, int whence)
+{
+    return static_cast<FileReader*>(opaque)->seek(offset, whence);
+}
+
+FormatContext::FormatContext(const std::string &fpath, ReadMode mode, std::size_t read_ahead, const ProbeOptions& probe)
+{
+    if(!init(fpath, mode, read_ahead, probe)) EXIT;
+}
+
+// nullptr instead of exiting when the file can't be opened or shows no streams
+std::unique_ptr<FormatContext> FormatContext::tryOpen(const std::string &fpath, ReadMode mode, std::size_t read_ahead,
+                                                      const ProbeOptions &probe)
+{
+    std::unique_ptr<FormatContext> f{new FormatContext};
+    if(!f->init(fpath, mode, read_ahead, probe)) return nullptr;
+    return f;
+}
+
+bool FormatContext::init(const std::string &fpath, ReadMode mode, std::size_t read_ahead, const ProbeOptions &probe)
+{
+    reader_ = FileReader::open(fpath, mode, read_ahead);
+    if(reader_)
     {
-        std::cerr << "Couldn't open input file. " << ffmpeg_error_string(ret) << "\n";
-        EXIT;
+        const int avio_size{256 * 1024};
+        unsigned char* buf = static_cast<unsigned char*>(av_malloc(avio_size));
+        avio_ = buf ? avio_alloc_context(buf, avio_size, 0, reader_.get(), avio_read, nullptr, avio_seek) : nullptr;
+        if(!avio_)
+        {
+            av_free(buf);
+            std::cerr << "Couldn't create custom I/O, reading through ffmpeg." << "\n";
+            reader_.reset();
+        }
     }
+    // a probe size cached from an earlier open reads just what that one needed, the full probe still runs
+    ProbeOptions first = probe;
+    int64_t cached = probe.cache ? loadProbeSize(fpath) : 0;
+    if(cached > 0) first.probe_size = cached;
+    if(!open(fpath, first)) return false;
 
-    ret = avformat_find_stream_info(fmt_, nullptr);
+    int ret = avformat_find_stream_info(fmt_, nullptr);
     if(ret < 0)
     {
         std::cerr << "Couldn't find any stream into file." << std::endl;
-        EXIT;
+        return false;
     }
+    bool complete = findStreams();
+    info_cached_ = cached > 0 && complete;
+    if(!complete && (first.probe_size > 0 || first.analyze_us > 0))
+    {
+        std::cerr << "Probe limits too small for this file, probing it again without them." << "\n";
+        avformat_close_input(&fmt_);
+        if(avio_) avio_seek(avio_, 0, SEEK_SET);
+        if(!open(fpath, ProbeOptions{0, 0, false})) return false;
+        ret = avformat_find_stream_info(fmt_, nullptr);
+        if(ret < 0)
+        {
+            std::cerr << "Couldn't find any stream into file." << std::endl;
+            return false;
+        }
+        complete = findStreams();
+    }
+    if(probe.cache && probe.save && complete && !info_cached_ && fmt_->pb) saveProbeSize(fpath, avio_tell(fmt_->pb));
+    return true;
+}
 
+// limits of 0 keep ffmpeg's defaults
+bool FormatContext::open(const std::string &fpath, const ProbeOptions& probe)
+{
+    fmt_ = avformat_alloc_context();
+    if(avio_)
+    {
+        fmt_->pb = avio_;
+        fmt_->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    if(probe.probe_size > 0) fmt_->probesize = probe.probe_size;
+    if(probe.analyze_us > 0) fmt_->max_analyze_duration = probe.analyze_us;
+    int ret = avformat_open_input(&fmt_, fpath.c_str(), nullptr, nullptr);
+    if(ret != 0)
+    {
+        std::cerr << "Couldn't open input file. " << ffmpeg_error_string(ret) << "\n";
+        return false;
+    }
+    return true;
+}
+
+/* Picks the streams to play, true when the video stream is described
+ * well enough to set up its decoder and converter. */
+bool FormatContext::findStreams()
+{
+    video_stream_ = audio_stream_ = nullptr;
     for(int i{0}; i < fmt_->nb_streams; i++)
     {
         if(fmt_->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) video_stream_ = fmt_->streams[i];
         else if(fmt_->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) audio_stream_ = fmt_->streams[i];
     }
+    if(!video_stream_) return false;
+    const AVCodecParameters* cp = video_stream_->codecpar;
+    return cp->width > 0 && cp->height > 0 && cp->format != AV_PIX_FMT_NONE;
 }
 
 FormatContext::~FormatContext()
@@ -123,6 +410,23 @@ FormatContext::~FormatContext()
         video_stream_ = nullptr;
         audio_stream_ = nullptr;
     }
+    if(avio_)
+    {
+        // custom I/O is ours to free, and ffmpeg may have swapped its buffer
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+    }
+}
+
+bool FormatContext::infoCached()
+{
+    return info_cached_;
+}
+
+ReaderStats FormatContext::readerStats()
+{
+    if(reader_) return reader_->stats();
+    return ReaderStats{};
 }
 
 AVFormatContext *FormatContext::self()
@@ -149,6 +453,12 @@ double FormatContext::fps()
     return 0.0;
 }
 
+AVRational FormatContext::frameRate()
+{
+    if(video_stream_) return video_stream_->avg_frame_rate;
+    return AVRational{0, 1};
+}
+
 AVRational FormatContext::videoTimeBase()
 {
     if(video_stream_) return video_stream_->time_base;
@@ -166,42 +476,62 @@ int64_t FormatContext::duration()
     return AV_NOPTS_VALUE ? fmt_->duration : video_stream_->duration;
 }
 
-CodecContext::CodecContext(AVStream *stream)
+CodecContext::CodecContext(AVStream *stream, int threads, int lowres)
+{
+    if(!init(stream, threads, lowres)) EXIT;
+}
+
+// nullptr instead of exiting when there is no decoder for the stream or it won't open
+std::unique_ptr<CodecContext> CodecContext::tryOpen(AVStream *stream, int threads, int lowres)
+{
+    std::unique_ptr<CodecContext> c{new CodecContext};
+    if(!c->init(stream, threads, lowres)) return nullptr;
+    return c;
+}
+
+bool CodecContext::init(AVStream *stream, int threads, int lowres)
 {
     const AVCodec* decoder = avcodec_find_decoder(stream->codecpar->codec_id);
     if(!decoder)
     {
         std::cerr << "Couldn't find decoder. " <<"\n";
-        EXIT;
+        return false;
     }
 
     ctx_ = avcodec_alloc_context3(decoder);
     if(!ctx_)
     {
         std::cerr << "Couldn't create codec context." <<"\n";
-        EXIT;
+        return false;
     }
 
     int ret = avcodec_parameters_to_context(ctx_, stream->codecpar);
     if(ret < 0)
     {
         std::cerr << "Couldn't copy codec parameters. " << ffmpeg_error_string(ret) << std::endl;
-        EXIT;
+        return false;
+    }
+
+    if(lowres > 0)
+    {
+        if(decoder->max_lowres > 0) ctx_->lowres = std::min(lowres, static_cast<int>(decoder->max_lowres));
+        else std::cerr << "Couldn't decode " << decoder->name << " at lower resolution, decoding at full size." << "\n";
     }
 
-    ret = av_dict_set(&opts_, "threads", "auto", 0);
+    ret = threads > 0 ? av_dict_set_int(&opts_, "threads", threads, 0) : av_dict_set(&opts_, "threads", "auto", 0);
     if(ret < 0)
     {
         std::cerr << "Couldn't set threads count. " << ffmpeg_error_string(ret) <<"\n";
-        EXIT;
+        return false;
     }
 
     ret = avcodec_open2(ctx_, decoder, &opts_);
     if(ret != 0)
     {
         std::cerr << "Couldn't open codec: " << ffmpeg_error_string(ret) <<"\n";
-        EXIT;
+        return false;
     }
+    return true;
 }
 
 CodecContext::~CodecContext()
@@ -272,6 +602,7 @@ Packet::~Packet()
 
 bool Packet::getPacket(FormatContext *f)
 {
+    VPL_TRACE_SCOPE("Packet::getPacket");
     return av_read_frame(f->self(), pkt_) >= 0;
 }
 
@@ -282,6 +613,7 @@ bool Packet::is_Stream(const int stream)
 
 bool Packet::send(CodecContext *c, int *eof)
 {
+    VPL_TRACE_SCOPE("Packet::send");
     int ret = avcodec_send_packet(c->self(), pkt_);
     if(ret == AVERROR_EOF)
     {
@@ -301,6 +633,26 @@ int64_t Packet::lenght()
     return pkt_->duration;
 }
 
+int64_t Packet::timeStamp()
+{
+    return pkt_->pts != AV_NOPTS_VALUE ? pkt_->pts : pkt_->dts;
+}
+
+int Packet::size()
+{
+    return pkt_->size;
+}
+
+int64_t Packet::position()
+{
+    return pkt_->pos;
+}
+
+bool Packet::isKey()
+{
+    return pkt_->flags & AV_PKT_FLAG_KEY;
+}
+
 void Packet::unref()
 {
     if(pkt_) av_packet_unref(pkt_);
@@ -326,6 +678,53 @@ Frame::~Frame()
     }
 }
 
+bool Frame::allocate(FramePool *pool, int width, int height, AVPixelFormat fmt)
+{
+    unref();
+    AVBufferRef* buf = pool->get();
+    if(!buf) return false;
+    int ret = av_image_fill_arrays(frame_->data, frame_->linesize, buf->data, fmt, width, height, 64);
+    if(ret < 0 || static_cast<std::size_t>(ret) > buf->size)
+    {
+        std::cerr << "Frame pool buffer too small for picture." << "\n";
+        av_buffer_unref(&buf);
+        return false;
+    }
+    frame_->buf[0] = buf;
+    frame_->width = width;
+    frame_->height = height;
+    frame_->format = fmt;
+    return true;
+}
+
+// shares src's buffers
+bool Frame::ref(Frame *src)
+{
+    unref();
+    return av_frame_ref(frame_, src->frame_) == 0;
+}
+
+// src's picture in buffers of its own, so src's buffers can go back where they came from
+bool Frame::copy(Frame *src)
+{
+    unref();
+    frame_->width = src->frame_->width;
+    frame_->height = src->frame_->height;
+    frame_->format = src->frame_->format;
+    if(av_frame_get_buffer(frame_, 0) < 0 || av_frame_copy(frame_, src->frame_) < 0 ||
+       av_frame_copy_props(frame_, src->frame_) < 0)
+    {
+        unref();
+        return false;
+    }
+    return true;
+}
+
+bool Frame::copyProps(Frame *src)
+{
+    return av_frame_copy_props(frame_, src->frame_) >= 0;
+}
+
 unsigned char **Frame::_data()
 {
     if(frame_) return  frame_->data;
@@ -340,10 +739,11 @@ int *Frame::linesize()
 
 bool Frame::receive(CodecContext *c, Packet *p)
 {
+    VPL_TRACE_SCOPE("Frame::receive");
     int ret = avcodec_receive_frame(c->self(), frame_);
     if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
     {
-        p->unref();
+        if(p) p->unref();
         return false;
     }
     else if(ret < 0)
@@ -372,15 +772,73 @@ int64_t Frame::timeStamp()
     return 0;
 }
 
+AVPixelFormat Frame::format()
+{
+    if(frame_) return static_cast<AVPixelFormat>(frame_->format);
+    return AV_PIX_FMT_NONE;
+}
+
+AVColorSpace Frame::colorSpace()
+{
+    if(frame_) return frame_->colorspace;
+    return AVCOL_SPC_UNSPECIFIED;
+}
+
+AVColorRange Frame::colorRange()
+{
+    if(frame_) return frame_->color_range;
+    return AVCOL_RANGE_UNSPECIFIED;
+}
+
+AVColorTransferCharacteristic Frame::colorTransfer()
+{
+    if(frame_) return frame_->color_trc;
+    return AVCOL_TRC_UNSPECIFIED;
+}
+
+int Frame::nbSamples()
+{
+    if(frame_) return frame_->nb_samples;
+    return 0;
+}
+
+unsigned char **Frame::extendedData()
+{
+    if(frame_) return frame_->extended_data;
+    return nullptr;
+}
+
 void Frame::unref()
 {
     if(frame_) av_frame_unref(frame_);
 }
 
-scale_image::scale_image(CodecContext *c)
+// below this a frame converts faster on one core than it takes to hand out the bands
+static const int64_t band_min_pixels{1280 * 720};
+static const int band_min_rows{64};
+static const int band_align{16};  // keeps band starts on chroma rows for any subsampling
+
+static std::vector<int> split_rows(int width, int height, unsigned workers)
+{
+    int bands{1};
+    if(static_cast<int64_t>(width) * height >= band_min_pixels)
+        bands = std::max(1, std::min(static_cast<int>(workers), height / band_min_rows));
+    int step = (height / bands + band_align - 1) / band_align * band_align;
+    std::vector<int> rows{0};
+    for(int y{step}; bands > 1 && y < height; y += step) rows.push_back(y);
+    rows.push_back(height);
+    return rows;
+}
+
+scale_image::scale_image(CodecContext *c):
+    fmt_{c->format()},
+    width_{c->width()},
+    kernels_{&yuvKernels()},
+    pool_{&ThreadPool::shared()}
 {
     sws_ = sws_getContext(c->width(), c->height(), c->format(), c->width(), c->height(), AV_PIX_FMT_RGB0, SWS_BILINEAR, nullptr,
                           nullptr, nullptr);
+    rows_ = split_rows(c->width(), c->height(), pool_->size() + 1);
 }
 
 scale_image::~scale_image()
@@ -390,15 +848,281 @@ scale_image::~scale_image()
         sws_freeContext(sws_);
         sws_ = nullptr;
     }
+    for(SwsContext* s : band_sws_) sws_freeContext(s);
+    if(resize_sws_) sws_freeContext(resize_sws_);
 }
 
-bool scale_image::getDataFromFrame(Frame *f, unsigned char *_buffer)
+bool scale_image::convertYuv(Frame *f, unsigned char *dst, int linesize)
 {
-    if(sws_)
+    YuvImage img;
+    int bits{8};
+    switch(f->format())
     {
-        unsigned char* dst[4] = {_buffer, nullptr, nullptr, nullptr};
-        int ln[4] = {f->width()*4, 0, 0, 0};
-        return sws_scale(sws_, f->_data(), f->linesize(), 0, f->height(), dst, ln) >= 0;
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P: img.format = YuvFormat::YUV420P; break;
+    case AV_PIX_FMT_NV12: img.format = YuvFormat::NV12; break;
+    case AV_PIX_FMT_YUV420P10:
+        img.format = YuvFormat::YUV420P10;
+        bits = 10;
+        break;
+    default: return false;
+    }
+    img.width = f->width();
+    img.height = f->height();
+    for(int i{0}; i < 3; i++)
+    {
+        img.data[i] = f->_data()[i];
+        img.linesize[i] = f->linesize()[i];
     }
+    double kr{0.2126}, kb{0.0722};
+    switch(f->colorSpace())
+    {
+    case AVCOL_SPC_BT709: break;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+        kr = 0.299;
+        kb = 0.114;
+        break;
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        kr = 0.2627;
+        kb = 0.0593;
+        break;
+    default:
+        if(img.height < 720)
+        {
+            kr = 0.299;
+            kb = 0.114;
+        }
+        break;
+    }
+    bool full = f->colorRange() == AVCOL_RANGE_JPEG || f->format() == AV_PIX_FMT_YUVJ420P;
+    YuvCoeffs k = yuvCoeffs(kr, kb, bits, full);
+    if(rows_.back() != img.height)
+    {
+        yuvToRgb(*kernels_, img, k, dst, linesize, 0, img.height);
+        return true;
+    }
+    pool_->parallelFor(static_cast<int>(rows_.size()) - 1, [&](int i)
+    {
+        yuvToRgb(*kernels_, img, k, dst, linesize, rows_[i], rows_[i + 1]);
+    });
+    return true;
+}
+
+bool scale_image::convertSws(Frame *f, unsigned char *dst, int linesize)
+{
+    unsigned char* out[4] = {dst, nullptr, nullptr, nullptr};
+    int ln[4] = {linesize, 0, 0, 0};
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt_);
+    bool banded = rows_.size() > 2 && f->height() == rows_.back() && f->width() == width_ && f->format() == fmt_ && desc &&
+                  !(desc->flags & AV_PIX_FMT_FLAG_PAL);
+    if(!banded) return sws_scale(sws_, f->_data(), f->linesize(), 0, f->height(), out, ln) >= 0;
+
+    if(band_sws_.empty())
+    {
+        for(std::size_t i{0}; i + 1 < rows_.size(); i++)
+        {
+            int h = rows_[i + 1] - rows_[i];
+            SwsContext* s = sws_getContext(width_, h, fmt_, width_, h, AV_PIX_FMT_RGB0, SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if(!s)
+            {
+                for(SwsContext* b : band_sws_) sws_freeContext(b);
+                band_sws_.clear();
+                rows_ = {0, rows_.back()};
+                return sws_scale(sws_, f->_data(), f->linesize(), 0, f->height(), out, ln) >= 0;
+            }
+            band_sws_.push_back(s);
+        }
+    }
+
+    // every band is a picture of its own starting at its first row
+    std::atomic<bool> ok{true};
+    pool_->parallelFor(static_cast<int>(band_sws_.size()), [&](int i)
+    {
+        const unsigned char* src[4] = {nullptr, nullptr, nullptr, nullptr};
+        for(int p{0}; p < 4; p++)
+        {
+            if(!f->_data()[p]) continue;
+            int shift = p == 1 || p == 2 ? desc->log2_chroma_h : 0;
+            src[p] = f->_data()[p] + static_cast<std::ptrdiff_t>(rows_[i] >> shift) * f->linesize()[p];
+        }
+        unsigned char* band_out[4] = {dst + static_cast<std::ptrdiff_t>(rows_[i]) * linesize, nullptr, nullptr, nullptr};
+        if(sws_scale(band_sws_[i], src, f->linesize(), 0, rows_[i + 1] - rows_[i], band_out, ln) < 0) ok = false;
+    });
+    return ok;
+}
+
+bool scale_image::convert(Frame *f, unsigned char *dst, int linesize)
+{
+    if(convertYuv(f, dst, linesize)) return true;
+    if(sws_) return convertSws(f, dst, linesize);
     return false;
 }
+
+bool scale_image::resize(Frame *f, Frame *dst)
+{
+    resize_sws_ = sws_getCachedContext(resize_sws_, f->width(), f->height(), f->format(), dst->width(), dst->height(),
+                                       dst->format(), SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if(!resize_sws_ || sws_scale(resize_sws_, f->_data(), f->linesize(), 0, f->height(), dst->_data(), dst->linesize()) < 0)
+        return false;
+    // color description for the shader when dst is still YUV
+    return dst->copyProps(f);
+}
+
+bool scale_image::getDataFromFrame(Frame *f, Frame *dst)
+{
+    VPL_TRACE_SCOPE("scale_image::getDataFromFrame");
+    if(dst->width() != f->width() || dst->height() != f->height() || dst->format() != AV_PIX_FMT_RGB0) return resize(f, dst);
+    return convert(f, dst->_data()[0], dst->linesize()[0]);
+}
+
+bool scale_image::getDataFromFrame(Frame *f, unsigned char *_buffer)
+{
+    VPL_TRACE_SCOPE("scale_image::getDataFromFrame");
+    return convert(f, _buffer, f->width()*4);
+}
+
+resample_audio::resample_audio(CodecContext *c, int out_rate, int out_channels):
+    out_rate_{out_rate},
+    out_channels_{out_channels}
+{
+    AVCodecContext* a = c->self();
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+    AVChannelLayout out_layout;
+    av_channel_layout_default(&out_layout, out_channels_);
+    int ret = swr_alloc_set_opts2(&swr_, &out_layout, AV_SAMPLE_FMT_FLT, out_rate_, &a->ch_layout, a->sample_fmt,
+                                  a->sample_rate, 0, nullptr);
+    av_channel_layout_uninit(&out_layout);
+#else
+    int64_t in_layout = a->channel_layout ? a->channel_layout : av_get_default_channel_layout(a->channels);
+    swr_ = swr_alloc_set_opts(nullptr, av_get_default_channel_layout(out_channels_), AV_SAMPLE_FMT_FLT, out_rate_,
+                              in_layout, a->sample_fmt, a->sample_rate, 0, nullptr);
+    int ret = swr_ ? 0 : AVERROR(ENOMEM);
+#endif
+    if(ret >= 0) ret = swr_init(swr_);
+    if(ret < 0)
+    {
+        std::cerr << "Couldn't create audio resampler. " << ffmpeg_error_string(ret) << "\n";
+        swr_free(&swr_);
+    }
+}
+
+resample_audio::~resample_audio()
+{
+    if(swr_) swr_free(&swr_);
+}
+
+bool resample_audio::ok()
+{
+    return swr_ != nullptr;
+}
+
+int resample_audio::convert(Frame *f, std::vector<float> &out)
+{
+    if(!swr_) return -1;
+    int max = swr_get_out_samples(swr_, f->nbSamples());
+    if(max <= 0) return 0;
+    out.resize(static_cast<std::size_t>(max) * out_channels_);
+    unsigned char* dst[1]{reinterpret_cast<unsigned char*>(out.data())};
+    return swr_convert(swr_, dst, max, const_cast<const unsigned char**>(f->extendedData()), f->nbSamples());
+}
+
+int resample_audio::rate()
+{
+    return out_rate_;
+}
+
+int resample_audio::channels()
+{
+    return out_channels_;
+}
+
+struct PoolRef
+{
+    FramePool* owner;
+    AVBufferRef* inner;
+};
+
+FramePool::FramePool(std::size_t buffer_size, std::size_t capacity):
+    size_{buffer_size},
+    capacity_{capacity ? capacity : 1}
+{
+    pool_ = av_buffer_pool_init(size_, nullptr);
+    if(!pool_)
+    {
+        std::cerr << "Couldn't create frame pool." << "\n";
+        EXIT;
+    }
+}
+
+FramePool::~FramePool()
+{
+    if(pool_)
+    {
+        av_buffer_pool_uninit(&pool_);
+        pool_ = nullptr;
+    }
+}
+
+AVBufferRef *FramePool::get()
+{
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        cv_.wait(lk, [this]{ return in_use_ < capacity_ || aborted_; });
+        if(aborted_) return nullptr;
+        in_use_++;
+        if(in_use_ > high_water_) high_water_ = in_use_;
+    }
+
+    // the pooled buffer is wrapped so its return can be counted, the pixels are not copied
+    AVBufferRef* inner = av_buffer_pool_get(pool_);
+    PoolRef* holder = inner ? new PoolRef{this, inner} : nullptr;
+    AVBufferRef* ref = holder ? av_buffer_create(inner->data, inner->size, &FramePool::release, holder, 0) : nullptr;
+    if(!ref)
+    {
+        if(holder) release(holder, nullptr);
+        else
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            in_use_--;
+        }
+        std::cerr << "Couldn't get buffer from frame pool." << "\n";
+        return nullptr;
+    }
+    return ref;
+}
+
+void FramePool::release(void *opaque, uint8_t *data)
+{
+    PoolRef* holder = static_cast<PoolRef*>(opaque);
+    FramePool* self = holder->owner;
+    av_buffer_unref(&holder->inner);
+    delete holder;
+    {
+        std::lock_guard<std::mutex> lk(self->mtx_);
+        self->in_use_--;
+    }
+    self->cv_.notify_one();
+}
+
+void FramePool::abort()
+{
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        aborted_ = true;
+    }
+    cv_.notify_all();
+}
+
+void FramePool::reset()
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    aborted_ = false;
+}
+
+PoolStats FramePool::stats()
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    return PoolStats{capacity_, in_use_, high_water_, size_};
+}
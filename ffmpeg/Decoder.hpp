@@ -3,27 +3,80 @@
 #include <string>
 #include <exception>
 #include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "FileReader.hpp"
+#include "StreamInfo.hpp"
 
 extern "C"
 {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
+#include <libswresample/swresample.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/channel_layout.h>
 }
 
+struct PoolStats
+{
+    std::size_t capacity{0};
+    std::size_t in_use{0};
+    std::size_t high_water{0};
+    std::size_t buffer_size{0};
+};
+
+/* Fixed size picture buffers recycled through an AVBufferPool.
+ * At most capacity buffers are handed out, get() blocks until one is
+ * returned. The pool must outlive every buffer it handed out. */
+class FramePool
+{
+private:
+    AVBufferPool* pool_{nullptr};
+    std::size_t size_{0};
+    std::size_t capacity_{0};
+    std::size_t in_use_{0};
+    std::size_t high_water_{0};
+    bool aborted_{false};
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    static void release(void* opaque, uint8_t* data);
+public:
+    FramePool(std::size_t buffer_size, std::size_t capacity);
+    ~FramePool();
+    AVBufferRef* get();
+    void abort();
+    void reset();
+    PoolStats stats();
+};
+
 class FormatContext
 {
 private:
     AVFormatContext* fmt_{nullptr};
+    std::unique_ptr<FileReader> reader_;
+    AVIOContext* avio_{nullptr};
     AVStream* video_stream_{nullptr};
     AVStream* audio_stream_{nullptr};
+    bool info_cached_{false};  // probe sized from the cache and that was enough
+    FormatContext() = default;
+    bool init(const std::string& fpath, ReadMode mode, std::size_t read_ahead, const ProbeOptions& probe);
+    bool open(const std::string& fpath, const ProbeOptions& probe);
+    bool findStreams();
 public:
-    FormatContext(const std::string& fpath);
+    FormatContext(const std::string& fpath, ReadMode mode = ReadMode::Auto, std::size_t read_ahead = 16 << 20,
+                  const ProbeOptions& probe = ProbeOptions{});
+    static std::unique_ptr<FormatContext> tryOpen(const std::string& fpath, ReadMode mode = ReadMode::Auto,
+                                                  std::size_t read_ahead = 16 << 20, const ProbeOptions& probe = ProbeOptions{});
     ~FormatContext();
+    bool infoCached();
+    ReaderStats readerStats();
     AVFormatContext* self();
     AVStream* video_ID();
     AVStream* audioID();
     double fps();
+    AVRational frameRate();
     AVRational videoTimeBase();
     AVRational audioTimeBase();
     int64_t duration();
@@ -34,8 +87,12 @@ class CodecContext
 private:
     AVCodecContext* ctx_{nullptr};
     AVDictionary* opts_{nullptr};
+    CodecContext() = default;
+    bool init(AVStream* stream, int threads, int lowres);
 public:
-    CodecContext(AVStream* stream);
+    // threads 0 lets the codec pick one per core, lowres > 0 decodes at 1/2^lowres size where the codec can
+    CodecContext(AVStream* stream, int threads = 0, int lowres = 0);
+    static std::unique_ptr<CodecContext> tryOpen(AVStream* stream, int threads = 0, int lowres = 0);
     ~CodecContext();
     AVCodecContext* self();
     int width();
@@ -55,6 +112,10 @@ public:
     bool is_Stream(const int stream);
     bool send(CodecContext* c, int* eof);
     int64_t lenght();
+    int64_t timeStamp();
+    int size();
+    int64_t position();
+    bool isKey();
     void unref();
 };
 
@@ -65,23 +126,92 @@ private:
 public:
     Frame();
     ~Frame();
+    bool allocate(FramePool* pool, int width, int height, AVPixelFormat fmt);
+    bool ref(Frame* src);
+    bool copy(Frame* src);
+    bool copyProps(Frame* src);
     unsigned char** _data();
     int* linesize();
     bool receive(CodecContext* c, Packet* p);
     int width();
     int height();
     int64_t timeStamp();
+    AVPixelFormat format();
+    AVColorSpace colorSpace();
+    AVColorRange colorRange();
+    AVColorTransferCharacteristic colorTransfer();
+    int nbSamples();
+    unsigned char** extendedData();
     void unref();
 };
 
+struct YuvKernels;
+class ThreadPool;
+
+/* Frame to RGB0 at the same size. yuv420p, nv12 and yuv420p10 go
+ * through the SIMD kernels picked for this CPU, anything else through
+ * sws. Large frames are cut into horizontal bands converted in parallel
+ * on the shared ThreadPool, sws then gets a context per band.
+ * A destination frame of another size or format is filled by a single
+ * sws pass scaling straight to it. */
 class scale_image
 {
 private:
     SwsContext* sws_{nullptr};
+    std::vector<SwsContext*> band_sws_;
+    SwsContext* resize_sws_{nullptr};
+    std::vector<int> rows_;  // first row of every band, then the height
+    AVPixelFormat fmt_;
+    int width_;
+    const YuvKernels* kernels_;
+    ThreadPool* pool_;
+    bool convertYuv(Frame* f, unsigned char* dst, int linesize);
+    bool convertSws(Frame* f, unsigned char* dst, int linesize);
+    bool convert(Frame* f, unsigned char* dst, int linesize);
+    bool resize(Frame* f, Frame* dst);
 public:
     scale_image(CodecContext* c);
     ~scale_image();
     bool getDataFromFrame(Frame* f, unsigned char* _buffer);
+    bool getDataFromFrame(Frame* f, Frame* dst);
+};
+
+class resample_audio
+{
+private:
+    SwrContext* swr_{nullptr};
+    int out_rate_;
+    int out_channels_;
+public:
+    resample_audio(CodecContext* c, int out_rate, int out_channels);
+    ~resample_audio();
+    bool ok();
+    int convert(Frame* f, std::vector<float>& out);
+    int rate();
+    int channels();
+};
+
+class KeyframeIndex;
+
+struct DecoderOptions
+{
+    bool audio{false};       // open the audio stream as well
+    bool index_scan{true};   // build the keyframe index in the background
+    ReadMode read_mode{ReadMode::Auto};
+    std::size_t read_ahead{16 << 20};
+    ProbeOptions probe;
+    int threads{0};          // video decoder threads, 0 for one per core
+    int lowres{0};           // decode at 1/2^lowres of the coded size, if the codec supports it
+};
+
+/* Exact decodes every frame from the keyframe to the target, Fast gets
+ * to the same target but drops non reference frames on the way, Snap
+ * shows the keyframe the seek landed on. */
+enum class SeekMode
+{
+    Exact,
+    Fast,
+    Snap
 };
 
 class Decoder
@@ -92,17 +222,46 @@ private:
     std::unique_ptr<Packet> pkt;
     std::unique_ptr<Frame> frame;
     std::unique_ptr<scale_image> si;
+    std::unique_ptr<KeyframeIndex> index;
+    std::unique_ptr<CodecContext> actx;
+    std::unique_ptr<resample_audio> sr;
+    int64_t bytes_read{0};
+    Decoder() = default;
+    bool init(const std::string& file_path, const DecoderOptions& opts);
+    bool decodeNextFrame(int* eof);
 public:
-    Decoder(const std::string& file_path);
-    ~Decoder() = default;
+    Decoder(const std::string& file_path, const DecoderOptions& opts = DecoderOptions{});
+    static std::unique_ptr<Decoder> tryOpen(const std::string& file_path, const DecoderOptions& opts = DecoderOptions{});
+    ~Decoder();
     bool readFrameFromDecoder(unsigned char* frame_buffer, int64_t* pts, int *eof);
+    bool readFrameFromDecoder(int64_t* pts, int* eof);
     bool readSeekFrameFromDecoder(int64_t pts, unsigned char* frame_buffer, int64_t* _ts, int* eof);
+    bool readPacket(Packet* p);
+    bool sendPacket(Packet* p, int* eof);
+    bool receiveFrame(Frame* f);
+    bool convertFrame(Frame* f, Frame* dst);
+    bool hasAudio();
+    bool isAudio(Packet* p);
+    bool sendAudioPacket(Packet* p, int* eof);
+    bool receiveAudioFrame(Frame* f);
+    int convertAudio(Frame* f, std::vector<float>& out);
+    AVRational audioTimeBase();
+    int audioRate();
+    int audioChannels();
+    int64_t bytesRead();
+    ReaderStats readerStats();
+    bool infoCached();
+    std::string codecName();
     int width();
     int height();
     double fps();
     int64_t duration();
     AVRational timeBase();
-    void seek(int64_t ts);
+    int64_t seek(int64_t ts);
+    void fastDecode(bool on);
+    void keyframesOnly(bool on);
     int64_t startTime();
+    int64_t frameToPts(int64_t frame);
+    KeyframeIndex* keyframes();
 };
 
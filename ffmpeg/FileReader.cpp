@@ -0,0 +1,253 @@
+#include "FileReader.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+extern "C"
+{
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+}
+
+static const std::size_t read_chunk{1 << 20};
+
+static int64_t elapsed_ns(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+}
+
+// network file systems, where mmap page faults turn into synchronous round trips
+static bool remote_fs(int fd)
+{
+    struct statfs fs;
+    if(fstatfs(fd, &fs) != 0) return false;
+    switch(static_cast<unsigned long>(fs.f_type))
+    {
+    case 0x6969:      // NFS
+    case 0xff534d42:  // CIFS
+    case 0xfe534d42:  // SMB2
+    case 0x65735546:  // FUSE
+    case 0x00c36400:  // Ceph
+        return true;
+    default: return false;
+    }
+}
+
+// modified in the last few seconds, likely still being recorded or copied
+static bool being_written(const struct stat& st)
+{
+    return std::time(nullptr) - st.st_mtime < 5;
+}
+
+std::unique_ptr<FileReader> FileReader::open(const std::string &path, ReadMode mode, std::size_t read_ahead)
+{
+    if(mode == ReadMode::Ffmpeg) return nullptr;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return nullptr;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    if(mode == ReadMode::Auto) mode = remote_fs(fd) || being_written(st) ? ReadMode::ReadAhead : ReadMode::Mmap;
+
+    if(mode == ReadMode::Mmap)
+    {
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(map == MAP_FAILED)
+        {
+            std::cerr << "Couldn't map input file, reading it through ffmpeg." << "\n";
+            return nullptr;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        return std::unique_ptr<FileReader>(new MappedFile(static_cast<const uint8_t*>(map), st.st_size, read_ahead));
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return std::unique_ptr<FileReader>(new ReadAheadFile(fd, st.st_size, std::max(read_ahead, 2 * read_chunk)));
+}
+
+ReadAheadFile::ReadAheadFile(int fd, int64_t size, std::size_t capacity):
+    fd_{fd},
+    size_{size},
+    ring_(capacity)
+{
+    fill_ = std::thread(&ReadAheadFile::fill, this);
+}
+
+ReadAheadFile::~ReadAheadFile()
+{
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+    }
+    space_.notify_all();
+    fill_.join();
+    ::close(fd_);
+}
+
+void ReadAheadFile::fill()
+{
+    const int64_t cap = static_cast<int64_t>(ring_.size());
+    std::unique_lock<std::mutex> lk(mtx_);
+    while(!stop_)
+    {
+        // bytes behind the demuxer beyond the kept quarter may be overwritten
+        int64_t floor = std::max(base_, pos_ - cap / 4);
+        int64_t room = cap - (end_ - floor);
+        if(failed_ || end_ >= size_ || room <= 0)
+        {
+            space_.wait(lk);
+            continue;
+        }
+        int64_t off = end_;
+        std::size_t n = static_cast<std::size_t>(std::min({room, static_cast<int64_t>(read_chunk), size_ - off, cap - off % cap}));
+        unsigned gen = gen_;
+        if(off + static_cast<int64_t>(n) - cap > base_) base_ = off + n - cap;
+        lk.unlock();
+        ssize_t got = pread(fd_, ring_.data() + off % cap, n, off);
+        lk.lock();
+        if(gen != gen_) continue;  // a seek dropped the ring meanwhile
+        if(got <= 0)
+        {
+            if(got < 0 && errno == EINTR) continue;
+            std::cerr << "Couldn't read input file at " << off << ": " << (got < 0 ? std::strerror(errno) : "short file") << "\n";
+            failed_ = true;
+        }
+        else
+        {
+            end_ += got;
+        }
+        data_.notify_all();
+    }
+}
+
+int ReadAheadFile::read(uint8_t *buf, int size)
+{
+    const int64_t cap = static_cast<int64_t>(ring_.size());
+    std::unique_lock<std::mutex> lk(mtx_);
+    if(pos_ >= size_) return AVERROR_EOF;
+    if(pos_ >= end_)
+    {
+        auto t = std::chrono::steady_clock::now();
+        data_.wait(lk, [this] { return pos_ < end_ || failed_; });
+        stall_ns_ += elapsed_ns(t);
+        if(pos_ >= end_) return AVERROR(EIO);
+    }
+    int64_t n = std::min({static_cast<int64_t>(size), end_ - pos_, cap - pos_ % cap});
+    // the filler never writes between base_ and end_, copying outside the lock is safe
+    int64_t at = pos_ % cap;
+    lk.unlock();
+    std::memcpy(buf, ring_.data() + at, n);
+    lk.lock();
+    pos_ += n;
+    bytes_read_ += n;
+    lk.unlock();
+    space_.notify_one();
+    return static_cast<int>(n);
+}
+
+int64_t ReadAheadFile::seek(int64_t offset, int whence)
+{
+    std::unique_lock<std::mutex> lk(mtx_);
+    whence &= ~AVSEEK_FORCE;
+    if(whence == AVSEEK_SIZE) return size_;
+    if(whence == SEEK_CUR) offset += pos_;
+    else if(whence == SEEK_END) offset += size_;
+    else if(whence != SEEK_SET) return AVERROR(EINVAL);
+    if(offset < 0) return AVERROR(EINVAL);
+
+    if(offset < base_ || offset > end_)
+    {
+        // outside what the ring holds, start over from there
+        gen_++;
+        base_ = end_ = offset;
+        failed_ = false;
+    }
+    pos_ = offset;
+    lk.unlock();
+    space_.notify_one();
+    return offset;
+}
+
+ReaderStats ReadAheadFile::stats()
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    ReaderStats st;
+    st.mode = "readahead";
+    st.bytes_read = bytes_read_;
+    st.stall_ms = stall_ns_ / 1e6;
+    st.buffered = static_cast<std::size_t>(std::max<int64_t>(end_ - pos_, 0));
+    st.capacity = ring_.size();
+    return st;
+}
+
+MappedFile::MappedFile(const uint8_t *map, int64_t size, std::size_t read_ahead):
+    map_{map},
+    size_{size},
+    read_ahead_{read_ahead}
+{}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<uint8_t*>(map_), size_);
+}
+
+int MappedFile::read(uint8_t *buf, int size)
+{
+    int64_t pos = pos_.load(std::memory_order_relaxed);
+    if(pos >= size_) return AVERROR_EOF;
+    int64_t n = std::min(static_cast<int64_t>(size), size_ - pos);
+
+    // keep the kernel read_ahead bytes in front, advised half a window at a time
+    int64_t advised = advised_.load(std::memory_order_relaxed);
+    if(advised < pos + static_cast<int64_t>(read_ahead_) / 2 && advised < size_)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        int64_t from = std::max(advised, pos) / page * page;
+        int64_t to = std::min(pos + static_cast<int64_t>(read_ahead_), size_);
+        madvise(const_cast<uint8_t*>(map_) + from, to - from, MADV_WILLNEED);
+        advised_.store(to, std::memory_order_relaxed);
+    }
+
+    auto t = std::chrono::steady_clock::now();
+    std::memcpy(buf, map_ + pos, n);
+    stall_ns_.fetch_add(elapsed_ns(t), std::memory_order_relaxed);
+    pos_.store(pos + n, std::memory_order_relaxed);
+    bytes_read_.fetch_add(n, std::memory_order_relaxed);
+    return static_cast<int>(n);
+}
+
+int64_t MappedFile::seek(int64_t offset, int whence)
+{
+    whence &= ~AVSEEK_FORCE;
+    if(whence == AVSEEK_SIZE) return size_;
+    if(whence == SEEK_CUR) offset += pos_.load(std::memory_order_relaxed);
+    else if(whence == SEEK_END) offset += size_;
+    else if(whence != SEEK_SET) return AVERROR(EINVAL);
+    if(offset < 0) return AVERROR(EINVAL);
+    pos_.store(offset, std::memory_order_relaxed);
+    advised_.store(offset, std::memory_order_relaxed);
+    return offset;
+}
+
+ReaderStats MappedFile::stats()
+{
+    ReaderStats st;
+    st.mode = "mmap";
+    st.bytes_read = bytes_read_.load(std::memory_order_relaxed);
+    st.stall_ms = stall_ns_.load(std::memory_order_relaxed) / 1e6;
+    int64_t ahead = std::min(advised_.load(std::memory_order_relaxed), size_) - pos_.load(std::memory_order_relaxed);
+    st.buffered = static_cast<std::size_t>(std::max<int64_t>(ahead, 0));
+    st.capacity = read_ahead_;
+    return st;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+/* Auto maps local files and reads network file systems and files
+ * still being written through the read-ahead thread; anything that
+ * isn't a regular file (URLs, pipes) is left to ffmpeg's own
+ * protocols, as is everything with Ffmpeg. */
+enum class ReadMode {Auto, Ffmpeg, ReadAhead, Mmap};
+
+struct ReaderStats
+{
+    const char* mode{"ffmpeg"};
+    int64_t bytes_read{0};     // handed to the demuxer
+    double stall_ms{0.0};      // demuxer waiting on the file
+    std::size_t buffered{0};   // read ahead of the demuxer right now
+    std::size_t capacity{0};
+};
+
+/* Byte source behind the custom AVIOContext of FormatContext.
+ * read() and seek() follow the AVIOContext callback conventions. */
+class FileReader
+{
+public:
+    virtual ~FileReader() = default;
+    virtual int read(uint8_t* buf, int size) = 0;
+    virtual int64_t seek(int64_t offset, int whence) = 0;
+    virtual ReaderStats stats() = 0;
+    // null when mode (after resolving Auto) leaves the file to ffmpeg or opening fails
+    static std::unique_ptr<FileReader> open(const std::string& path, ReadMode mode, std::size_t read_ahead);
+};
+
+/* A background thread keeps up to capacity bytes ahead of the demuxer
+ * with large pread()s. A quarter of the ring keeps bytes already read,
+ * so the short backward seeks of probing stay in memory. */
+class ReadAheadFile : public FileReader
+{
+private:
+    int fd_;
+    int64_t size_;
+    std::vector<uint8_t> ring_;
+    int64_t base_{0};    // oldest byte still in the ring
+    int64_t pos_{0};     // next byte for the demuxer
+    int64_t end_{0};     // one past the newest byte in the ring
+    unsigned gen_{0};    // bumped by seeks that drop the ring
+    bool failed_{false};
+    bool stop_{false};
+    int64_t bytes_read_{0};
+    int64_t stall_ns_{0};
+    std::mutex mtx_;
+    std::condition_variable data_;
+    std::condition_variable space_;
+    std::thread fill_;
+    void fill();
+public:
+    ReadAheadFile(int fd, int64_t size, std::size_t capacity);
+    ~ReadAheadFile();
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    ReaderStats stats() override;
+};
+
+/* The whole file mapped read only. Reads are copies out of the map,
+ * the kernel is asked to fetch read_ahead bytes past the demuxer, and
+ * stall time is what the copies cost including their page faults.
+ * The map is sized when opened: bytes appended later aren't seen, and
+ * a file truncated while mapped raises SIGBUS on the lost pages. Auto
+ * leaves recently modified files to ReadAheadFile for that reason. */
+class MappedFile : public FileReader
+{
+private:
+    const uint8_t* map_;
+    int64_t size_;
+    std::size_t read_ahead_;
+    std::atomic<int64_t> pos_{0};
+    std::atomic<int64_t> advised_{0};
+    std::atomic<int64_t> bytes_read_{0};
+    std::atomic<int64_t> stall_ns_{0};
+public:
+    MappedFile(const uint8_t* map, int64_t size, std::size_t read_ahead);
+    ~MappedFile();
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t offset, int whence) override;
+    ReaderStats stats() override;
+};
@@ -0,0 +1,173 @@
+#include "KeyframeIndex.hpp"
+#include "../utils/FileCache.hpp"
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+static const char* sidecar_magic = "vplidx";
+static const int sidecar_version = 1;
+
+static bool by_pts(const KeyframeEntry& a, const KeyframeEntry& b)
+{
+    return a.pts < b.pts;
+}
+
+KeyframeIndex::KeyframeIndex(const std::string &file_path, int stream_index, bool scan):
+    path_{file_path},
+    stream_{stream_index}
+{
+    sidecar_ = cacheFile(path_, ".vplidx");
+    fileStamp(path_, &file_size_, &file_mtime_);
+    if(!load() && scan) scan_ = std::thread(&KeyframeIndex::scan, this);
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+    abort_ = true;
+    if(scan_.joinable()) scan_.join();
+}
+
+bool KeyframeIndex::load()
+{
+    if(sidecar_.empty() || file_size_ < 0) return false;
+    std::ifstream in(sidecar_);
+    if(!in) return false;
+
+    std::string magic;
+    int version{0}, stream{-1};
+    int64_t size{0}, mtime{0};
+    std::size_t count{0};
+    in >> magic >> version >> size >> mtime >> stream >> count;
+    if(!in || magic != sidecar_magic || version != sidecar_version || size != file_size_ || mtime != file_mtime_ ||
+       stream != stream_) return false;
+
+    std::vector<KeyframeEntry> entries(count);
+    for(auto& e : entries) in >> e.pts >> e.pos >> e.frame;
+    if(!in) return false;
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    entries_ = std::move(entries);
+    complete_ = true;
+    return true;
+}
+
+void KeyframeIndex::save()
+{
+    if(sidecar_.empty() || file_size_ < 0) return;
+    std::string tmp = sidecar_ + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if(!out) return;
+        std::lock_guard<std::mutex> lk(mtx_);
+        out << sidecar_magic << " " << sidecar_version << " " << file_size_ << " " << file_mtime_ << " " << stream_ << " "
+            << entries_.size() << "\n";
+        for(const auto& e : entries_) out << e.pts << " " << e.pos << " " << e.frame << "\n";
+        if(!out) return;
+    }
+    std::rename(tmp.c_str(), sidecar_.c_str());
+}
+
+void KeyframeIndex::scan()
+{
+    AVFormatContext* fmt = nullptr;
+    if(avformat_open_input(&fmt, path_.c_str(), nullptr, nullptr) != 0) return;
+    if(stream_ < 0 || stream_ >= static_cast<int>(fmt->nb_streams))
+    {
+        avformat_close_input(&fmt);
+        return;
+    }
+    for(unsigned int i{0}; i < fmt->nb_streams; i++)
+    {
+        if(static_cast<int>(i) != stream_) fmt->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    std::vector<KeyframeEntry> entries;
+    AVPacket* pkt = av_packet_alloc();
+    int64_t frame{0};
+    while(!abort_ && pkt && av_read_frame(fmt, pkt) >= 0)
+    {
+        if(pkt->stream_index == stream_)
+        {
+            int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if((pkt->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE)
+                entries.push_back(KeyframeEntry{ts, pkt->pos, frame});
+            frame++;
+        }
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&fmt);
+    if(abort_) return;
+
+    std::stable_sort(entries.begin(), entries.end(), by_pts);
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        entries_ = std::move(entries);
+        complete_ = true;
+    }
+    save();
+}
+
+void KeyframeIndex::add(int64_t pts, int64_t pos)
+{
+    if(pts == AV_NOPTS_VALUE) return;
+    std::lock_guard<std::mutex> lk(mtx_);
+    if(complete_) return;
+    KeyframeEntry e{pts, pos, -1};
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), e, by_pts);
+    if(it != entries_.end() && it->pts == pts) return;
+    entries_.insert(it, e);
+}
+
+bool KeyframeIndex::find(int64_t pts, KeyframeEntry *e)
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    KeyframeEntry key{pts, -1, -1};
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), key, by_pts);
+    if(it == entries_.begin()) return false;
+    *e = *(it - 1);
+    return true;
+}
+
+/* Like find(), but only once the index is complete. Keyframes added
+ * while playing leave gaps wherever playback seeked past, so a partial
+ * index can't tell whether the entry before pts is really the last
+ * keyframe before it, even when later keyframes are known. */
+bool KeyframeIndex::findKnown(int64_t pts, KeyframeEntry *e)
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    if(!complete_) return false;
+    KeyframeEntry key{pts, -1, -1};
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), key, by_pts);
+    if(it == entries_.begin()) return false;
+    *e = *(it - 1);
+    return true;
+}
+
+bool KeyframeIndex::findFrame(int64_t frame, KeyframeEntry *e)
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    if(!complete_) return false;
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), frame,
+                               [](int64_t f, const KeyframeEntry& k){ return f < k.frame; });
+    if(it == entries_.begin()) return false;
+    *e = *(it - 1);
+    return true;
+}
+
+bool KeyframeIndex::complete()
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    return complete_;
+}
+
+std::size_t KeyframeIndex::size()
+{
+    std::lock_guard<std::mutex> lk(mtx_);
+    return entries_.size();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+struct KeyframeEntry
+{
+    int64_t pts{0};
+    int64_t pos{-1};
+    int64_t frame{-1};  // decode order number of the video packet, -1 if unknown
+};
+
+/* Keyframes of one video stream sorted by pts.
+ * Loaded from a sidecar in the cache directory when its size/mtime key
+ * still matches the file, otherwise built by a background packet scan
+ * and saved once complete. Keyframes seen while playing are added as
+ * they come so seeks improve before the scan is done, or instead of it
+ * when scanning is turned off. */
+class KeyframeIndex
+{
+private:
+    std::string path_;
+    std::string sidecar_;
+    int64_t file_size_{-1};
+    int64_t file_mtime_{0};
+    int stream_;
+    std::vector<KeyframeEntry> entries_;
+    bool complete_{false};
+    std::mutex mtx_;
+    std::thread scan_;
+    std::atomic<bool> abort_{false};
+    bool load();
+    void save();
+    void scan();
+public:
+    KeyframeIndex(const std::string& file_path, int stream_index, bool scan = true);
+    ~KeyframeIndex();
+    void add(int64_t pts, int64_t pos);
+    bool find(int64_t pts, KeyframeEntry* e);
+    bool findKnown(int64_t pts, KeyframeEntry* e);
+    bool findFrame(int64_t frame, KeyframeEntry* e);
+    bool complete();
+    std::size_t size();
+};
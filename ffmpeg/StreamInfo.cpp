@@ -0,0 +1,39 @@
+#include "StreamInfo.hpp"
+#include "../utils/FileCache.hpp"
+#include <fstream>
+#include <cstdio>
+
+static const char* sidecar_magic = "vplinfo";
+static const int sidecar_version = 2;
+
+int64_t loadProbeSize(const std::string &path)
+{
+    int64_t file_size{-1}, file_mtime{0};
+    std::string sidecar = cacheFile(path, ".vplinfo");
+    if(sidecar.empty() || !fileStamp(path, &file_size, &file_mtime)) return 0;
+    std::ifstream in(sidecar);
+    if(!in) return 0;
+
+    std::string magic;
+    int version{0};
+    int64_t size{0}, mtime{0}, bytes{0};
+    in >> magic >> version >> size >> mtime >> bytes;
+    if(!in || magic != sidecar_magic || version != sidecar_version || size != file_size || mtime != file_mtime ||
+       bytes <= 0) return 0;
+    return bytes;
+}
+
+void saveProbeSize(const std::string &path, int64_t bytes)
+{
+    int64_t file_size{-1}, file_mtime{0};
+    std::string sidecar = cacheFile(path, ".vplinfo");
+    if(sidecar.empty() || !fileStamp(path, &file_size, &file_mtime) || bytes <= 0) return;
+    std::string tmp = sidecar + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if(!out) return;
+        out << sidecar_magic << " " << sidecar_version << " " << file_size << " " << file_mtime << " " << bytes << "\n";
+        if(!out) return;
+    }
+    std::rename(tmp.c_str(), sidecar.c_str());
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+/* How much avformat_find_stream_info may read before giving up on the
+ * streams it hasn't fully described. A probe that still leaves the
+ * video stream without a size or pixel format is run again with
+ * ffmpeg's own limits. */
+struct ProbeOptions
+{
+    int64_t probe_size{1 << 20};      // bytes
+    int64_t analyze_us{500000};       // stream time
+    bool cache{true};                 // size the probe from what an earlier open needed
+    bool save{true};                  // and record what this one needed
+};
+
+/* Bytes an earlier open of path read before its probe described every
+ * stream, kept in a sidecar next to the keyframe index. The next open
+ * still probes all streams, but reads no more than that.
+ * loadProbeSize() returns 0 when nothing matching the file is cached. */
+int64_t loadProbeSize(const std::string& path);
+void saveProbeSize(const std::string& path, int64_t bytes);
@@ -1,8 +1,191 @@
 #include "Player.hpp"
+#include "tools/Bench.hpp"
+#include "tools/ConvertCheck.hpp"
+#include "tools/Thumbnails.hpp"
+#include "tools/Extract.hpp"
+#include "tools/LibraryProbe.hpp"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
 
-int main(int argc, const char** argv)
+static int usage()
+{
+    std::cerr << "usage: vpl [--no-drop] [--late-ms MS] [--drop-ms MS] [--convert-drop-ms MS] [--reverse-mb MB] [--step-cache-mb MB] [--lowres N] [--no-tonemap] [--hdr-peak NITS] [io options] <file|playlist.m3u>..." << "\n"
+              << "       vpl --bench [--no-convert] [--frames N] [io options] <file>" << "\n"
+              << "       vpl --thumbnails N [--width W] [--columns C] [--workers N] [-o sprite.png] [io options] <file>" << "\n"
+              << "       vpl --extract <list> [-o dir] [--raw] [--workers N] [--encoders N] [io options]" << "\n"
+              << "       vpl --probe <dir> [--workers N] [--write-info-cache] [io options]" << "\n"
+              << "       vpl --check-convert" << "\n"
+              << "io options: --io auto|ffmpeg|readahead|mmap  --read-ahead MB  --probe-size KB  --analyze-ms MS  --no-info-cache" << "\n";
+    return EXIT_FAILURE;
+}
+
+// --io, --read-ahead and the probe limits, shared by every mode that opens a file
+static bool io_option(int argc, const char** argv, int* i, ReadMode* mode, std::size_t* read_ahead, ProbeOptions* probe)
+{
+    if(std::strcmp(argv[*i], "--no-info-cache") == 0)
+    {
+        probe->cache = false;
+        return true;
+    }
+    if(*i + 1 >= argc) return false;
+    if(std::strcmp(argv[*i], "--read-ahead") == 0)
+    {
+        *read_ahead = static_cast<std::size_t>(std::max(1, std::atoi(argv[++*i]))) << 20;
+        return true;
+    }
+    // 0 lifts the limit back to ffmpeg's default
+    if(std::strcmp(argv[*i], "--probe-size") == 0)
+    {
+        probe->probe_size = static_cast<int64_t>(std::max(0, std::atoi(argv[++*i]))) << 10;
+        return true;
+    }
+    if(std::strcmp(argv[*i], "--analyze-ms") == 0)
+    {
+        probe->analyze_us = static_cast<int64_t>(std::max(0, std::atoi(argv[++*i]))) * 1000;
+        return true;
+    }
+    if(std::strcmp(argv[*i], "--io") != 0) return false;
+    const char* m = argv[++*i];
+    if(std::strcmp(m, "ffmpeg") == 0) *mode = ReadMode::Ffmpeg;
+    else if(std::strcmp(m, "readahead") == 0) *mode = ReadMode::ReadAhead;
+    else if(std::strcmp(m, "mmap") == 0) *mode = ReadMode::Mmap;
+    else if(std::strcmp(m, "auto") == 0) *mode = ReadMode::Auto;
+    else
+    {
+        std::cerr << "Unknown --io mode " << m << "\n";
+        std::exit(usage());
+    }
+    return true;
+}
+
+static int bench(int argc, const char** argv)
+{
+    BenchOptions opts;
+    for(int i{2}; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--no-convert") == 0) opts.convert = false;
+        else if(std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) opts.max_frames = std::atoll(argv[++i]);
+        else if(io_option(argc, argv, &i, &opts.read_mode, &opts.read_ahead, &opts.probe)) continue;
+        else opts.file = argv[i];
+    }
+    if(opts.file.empty()) return usage();
+    return runBench(opts);
+}
+
+static int thumbnails(int argc, const char** argv)
+{
+    ThumbnailOptions opts;
+    if(argc < 3) return usage();
+    opts.count = std::atoi(argv[2]);
+    for(int i{3}; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--width") == 0 && i + 1 < argc) opts.tile_width = std::atoi(argv[++i]);
+        else if(std::strcmp(argv[i], "--columns") == 0 && i + 1 < argc) opts.columns = std::atoi(argv[++i]);
+        else if(std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) opts.workers = std::max(0, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) opts.out = argv[++i];
+        else if(io_option(argc, argv, &i, &opts.read_mode, &opts.read_ahead, &opts.probe)) continue;
+        else opts.file = argv[i];
+    }
+    if(opts.file.empty() || opts.count <= 0) return usage();
+    return runThumbnails(opts);
+}
+
+static int extract(int argc, const char** argv)
+{
+    ExtractOptions opts;
+    for(int i{2}; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--raw") == 0) opts.png = false;
+        else if(std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) opts.out_dir = argv[++i];
+        else if(std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) opts.workers = std::max(0, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--encoders") == 0 && i + 1 < argc) opts.encoders = std::max(0, std::atoi(argv[++i]));
+        else if(io_option(argc, argv, &i, &opts.read_mode, &opts.read_ahead, &opts.probe)) continue;
+        else opts.list = argv[i];
+    }
+    if(opts.list.empty()) return usage();
+    return runExtract(opts);
+}
+
+static int probe(int argc, const char** argv)
+{
+    LibraryProbeOptions opts;
+    for(int i{2}; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) opts.workers = std::max(0, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--write-info-cache") == 0) opts.write_cache = true;
+        else if(io_option(argc, argv, &i, &opts.read_mode, &opts.read_ahead, &opts.probe)) continue;
+        else opts.dir = argv[i];
+    }
+    if(opts.dir.empty()) return usage();
+    return runLibraryProbe(opts);
+}
+
+static bool ends_with(const std::string& s, const char* suffix)
 {
-    Player play{argv[1]};
-    play();
+    std::size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// one path per line, # comments (m3u tags included), relative paths taken from the playlist's directory
+static void read_playlist(const std::string& list, std::vector<std::string>& files)
+{
+    std::ifstream in{list};
+    if(!in)
+    {
+        std::cerr << "Couldn't open playlist " << list << "\n";
+        return;
+    }
+    std::size_t slash = list.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "" : list.substr(0, slash + 1);
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        if(line.empty() || line[0] == '#') continue;
+        bool absolute = line[0] == '/' || line.find("://") != std::string::npos;
+        files.push_back(absolute ? line : dir + line);
+    }
+}
+
+static int play(int argc, const char** argv)
+{
+    PlayerOptions opts;
+    DropPolicy& drop = opts.drop;
+    std::vector<std::string> files;
+    for(int i{1}; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--no-drop") == 0) drop.present_drop_ms = drop.convert_drop_ms = 0.0;
+        else if(std::strcmp(argv[i], "--late-ms") == 0 && i + 1 < argc) drop.late_ms = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--drop-ms") == 0 && i + 1 < argc) drop.present_drop_ms = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--convert-drop-ms") == 0 && i + 1 < argc) drop.convert_drop_ms = std::atof(argv[++i]);
+        else if(std::strcmp(argv[i], "--reverse-mb") == 0 && i + 1 < argc)
+            opts.reverse_budget = static_cast<std::size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        else if(std::strcmp(argv[i], "--step-cache-mb") == 0 && i + 1 < argc)
+            opts.step_cache = static_cast<std::size_t>(std::max(0, std::atoi(argv[++i]))) << 20;
+        else if(std::strcmp(argv[i], "--lowres") == 0 && i + 1 < argc) opts.lowres = std::max(0, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--no-tonemap") == 0) opts.tone_map = false;
+        else if(std::strcmp(argv[i], "--hdr-peak") == 0 && i + 1 < argc) opts.hdr_peak = std::atof(argv[++i]);
+        else if(io_option(argc, argv, &i, &opts.read_mode, &opts.read_ahead, &opts.probe)) continue;
+        else if(ends_with(argv[i], ".m3u") || ends_with(argv[i], ".m3u8")) read_playlist(argv[i], files);
+        else files.push_back(argv[i]);
+    }
+    if(files.empty()) return usage();
+
+    Player player{files, opts};
+    player();
     return 0;
 }
+
+int main(int argc, const char** argv)
+{
+    if(argc < 2) return usage();
+    if(std::strcmp(argv[1], "--bench") == 0) return bench(argc, argv);
+    if(std::strcmp(argv[1], "--thumbnails") == 0) return thumbnails(argc, argv);
+    if(std::strcmp(argv[1], "--extract") == 0) return extract(argc, argv);
+    if(std::strcmp(argv[1], "--probe") == 0) return probe(argc, argv);
+    if(std::strcmp(argv[1], "--check-convert") == 0) return runConvertCheck();
+    return play(argc, argv);
+}
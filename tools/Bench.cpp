@@ -0,0 +1,68 @@
+#include "Bench.hpp"
+#include "../ffmpeg/Decoder.hpp"
+#include "../utils/Json.hpp"
+#include "../utils/Trace.hpp"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if(sorted.empty()) return 0.0;
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * sorted.size()));
+    if(rank > 0) rank--;
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+int runBench(const BenchOptions &opts)
+{
+    DecoderOptions dopts;
+    dopts.index_scan = false;
+    dopts.read_mode = opts.read_mode;
+    dopts.read_ahead = opts.read_ahead;
+    dopts.probe = opts.probe;
+    using clock = std::chrono::steady_clock;
+    auto opened = clock::now();
+    Decoder dec{opts.file, dopts};
+    double open_ms = std::chrono::duration<double, std::milli>(clock::now() - opened).count();
+
+    std::vector<unsigned char> pic(opts.convert ? dec.width()*dec.height()*4 : 0);
+    std::vector<double> latency;
+    int64_t ts{0};
+    int eof{0};
+    auto start = clock::now();
+    while(opts.max_frames <= 0 || static_cast<int64_t>(latency.size()) < opts.max_frames)
+    {
+        auto t = clock::now();
+        bool ok = opts.convert ? dec.readFrameFromDecoder(pic.data(), &ts, &eof) : dec.readFrameFromDecoder(&ts, &eof);
+        if(!ok) break;
+        latency.push_back(std::chrono::duration<double, std::milli>(clock::now() - t).count());
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    double first_ms = latency.empty() ? 0.0 : open_ms + latency.front();
+
+    double mean{0.0};
+    for(double l : latency) mean += l;
+    if(!latency.empty()) mean /= latency.size();
+    std::sort(latency.begin(), latency.end());
+    double fps = seconds > 0.0 ? latency.size() / seconds : 0.0;
+    double mbps = seconds > 0.0 ? dec.bytesRead() / (1024.0 * 1024.0) / seconds : 0.0;
+    ReaderStats io = dec.readerStats();
+
+    std::printf("{\"file\": %s, \"codec\": %s, \"width\": %d, \"height\": %d, \"convert\": %s, "
+                "\"open_ms\": %.3f, \"info_cached\": %s, \"first_frame_ms\": %.3f, "
+                "\"frames\": %zu, \"complete\": %s, \"seconds\": %.3f, \"fps\": %.2f, \"demux_bytes\": %lld, \"demux_mb_per_s\": %.2f, "
+                "\"latency_ms\": {\"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+                "\"io\": {\"mode\": \"%s\", \"bytes_read\": %lld, \"stall_ms\": %.3f, \"buffered\": %zu, \"capacity\": %zu}}\n",
+                jsonString(opts.file).c_str(), jsonString(dec.codecName()).c_str(), dec.width(), dec.height(),
+                opts.convert ? "true" : "false", open_ms, dec.infoCached() ? "true" : "false",
+                first_ms, latency.size(), eof == 1 ? "true" : "false", seconds, fps,
+                static_cast<long long>(dec.bytesRead()), mbps, mean, percentile(latency, 0.0), percentile(latency, 50.0),
+                percentile(latency, 90.0), percentile(latency, 99.0), percentile(latency, 100.0), io.mode,
+                static_cast<long long>(io.bytes_read), io.stall_ms, io.buffered, io.capacity);
+    traceDump(true);
+    return latency.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
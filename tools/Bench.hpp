@@ -0,0 +1,19 @@
+#pragma once
+#include "../ffmpeg/FileReader.hpp"
+#include "../ffmpeg/StreamInfo.hpp"
+#include <string>
+#include <cstdint>
+
+struct BenchOptions
+{
+    std::string file;
+    bool convert{true};      // run scale_image on every frame as well
+    int64_t max_frames{0};   // 0 decodes the whole file
+    ReadMode read_mode{ReadMode::Auto};
+    std::size_t read_ahead{16 << 20};
+    ProbeOptions probe;
+};
+
+/* Decodes opts.file as fast as possible without a window and prints
+ * throughput and per frame latency percentiles as JSON on stdout. */
+int runBench(const BenchOptions& opts);
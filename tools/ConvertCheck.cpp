@@ -0,0 +1,185 @@
+#include "ConvertCheck.hpp"
+#include "../utils/YuvToRgb.hpp"
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+
+namespace
+{
+struct FormatCase
+{
+    const char* name;
+    YuvFormat format;
+    AVPixelFormat pix_fmt;
+    int bits;
+};
+
+struct MatrixCase
+{
+    const char* name;
+    double kr, kb;
+    int sws_space;
+};
+
+const FormatCase formats[]{
+    {"yuv420p", YuvFormat::YUV420P, AV_PIX_FMT_YUV420P, 8},
+    {"nv12", YuvFormat::NV12, AV_PIX_FMT_NV12, 8},
+    {"yuv420p10", YuvFormat::YUV420P10, AV_PIX_FMT_YUV420P10, 10},
+};
+
+const MatrixCase matrices[]{
+    {"bt601", 0.299, 0.114, SWS_CS_ITU601},
+    {"bt709", 0.2126, 0.0722, SWS_CS_ITU709},
+};
+
+const char* const simd_names[]{"sse4.1", "avx2", "avx512"};
+
+// random planes of one picture, samples kept within the bit depth
+struct TestPicture
+{
+    std::vector<uint16_t> planes[3];
+    YuvImage img;
+    TestPicture(const FormatCase& fc, int width, int height, std::mt19937& rng)
+    {
+        int cw = (width + 1) / 2, ch = (height + 1) / 2;
+        int bytes = fc.bits > 8 ? 2 : 1;
+        int widths[3]{width, fc.format == YuvFormat::NV12 ? cw * 2 : cw, cw};
+        int heights[3]{height, ch, ch};
+        int count = fc.format == YuvFormat::NV12 ? 2 : 3;
+        img.format = fc.format;
+        img.width = width;
+        img.height = height;
+        for(int i{0}; i < count; i++)
+        {
+            // uint16 storage keeps every row 2 byte aligned for the 10 bit case
+            int linesize = (widths[i] * bytes + 63) & ~63;
+            planes[i].resize(linesize / 2 * heights[i]);
+            uint8_t* p = reinterpret_cast<uint8_t*>(planes[i].data());
+            for(int y{0}; y < heights[i]; y++)
+            {
+                for(int x{0}; x < widths[i]; x++)
+                {
+                    unsigned v = rng() & ((1u << fc.bits) - 1);
+                    if(bytes == 2) reinterpret_cast<uint16_t*>(p + y * linesize)[x] = static_cast<uint16_t>(v);
+                    else p[y * linesize + x] = static_cast<uint8_t>(v);
+                }
+            }
+            img.data[i] = p;
+            img.linesize[i] = linesize;
+        }
+    }
+};
+
+bool sws_convert(SwsContext* sws, const YuvImage& img, uint8_t* dst, int linesize)
+{
+    // sws looks at four planes
+    const uint8_t* in[4]{img.data[0], img.data[1], img.data[2], nullptr};
+    int in_ln[4]{img.linesize[0], img.linesize[1], img.linesize[2], 0};
+    uint8_t* out[4]{dst, nullptr, nullptr, nullptr};
+    int ln[4]{linesize, 0, 0, 0};
+    return sws_scale(sws, in, in_ln, 0, img.height, out, ln) >= 0;
+}
+
+SwsContext* sws_open(const FormatCase& fc, const MatrixCase& mc, bool full, int width, int height)
+{
+    SwsContext* sws = sws_getContext(width, height, fc.pix_fmt, width, height, AV_PIX_FMT_RGB0, SWS_BILINEAR, nullptr,
+                                     nullptr, nullptr);
+    if(sws)
+    {
+        sws_setColorspaceDetails(sws, sws_getCoefficients(mc.sws_space), full ? 1 : 0, sws_getCoefficients(SWS_CS_DEFAULT),
+                                 1, 0, 1 << 16, 1 << 16);
+    }
+    return sws;
+}
+
+template<typename F>
+double time_ms(F&& f, int runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(int i{0}; i < runs; i++) f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+}
+}
+
+int runConvertCheck()
+{
+    std::mt19937 rng{1};
+    bool ok{true};
+    const int width{1918}, height{1080};  // not a multiple of any vector width, exercises the scalar tails
+    std::vector<uint8_t> ref(width * height * 4), out(width * height * 4);
+
+    for(const FormatCase& fc : formats)
+    {
+        TestPicture pic{fc, width, height, rng};
+        for(const MatrixCase& mc : matrices)
+        {
+            for(bool full : {false, true})
+            {
+                YuvCoeffs k = yuvCoeffs(mc.kr, mc.kb, fc.bits, full);
+                yuvToRgb(yuvScalarKernels(), pic.img, k, ref.data(), width * 4, 0, height);
+
+                std::printf("{\"format\": \"%s\", \"matrix\": \"%s\", \"range\": \"%s\", \"kernels\": {", fc.name, mc.name,
+                            full ? "full" : "limited");
+                const char* sep = "";
+                for(const char* name : simd_names)
+                {
+                    const YuvKernels* kernels = yuvKernels(name);
+                    if(!kernels) continue;
+                    yuvToRgb(*kernels, pic.img, k, out.data(), width * 4, 0, height);
+                    bool exact = out == ref;
+                    ok = ok && exact;
+                    std::printf("%s\"%s\": %s", sep, name, exact ? "\"exact\"" : "\"MISMATCH\"");
+                    sep = ", ";
+                }
+                std::printf("}");
+
+                int max_diff{-1};
+                SwsContext* sws = sws_open(fc, mc, full, width, height);
+                if(sws && sws_convert(sws, pic.img, out.data(), width * 4))
+                {
+                    max_diff = 0;
+                    for(std::size_t i{0}; i < ref.size(); i++)
+                    {
+                        if(i % 4 == 3) continue;
+                        max_diff = std::max(max_diff, std::abs(static_cast<int>(ref[i]) - static_cast<int>(out[i])));
+                    }
+                }
+                if(sws) sws_freeContext(sws);
+                std::printf(", \"sws_max_diff\": %d}\n", max_diff);
+            }
+        }
+    }
+
+    const int bw{3840}, bh{2160}, runs{20};
+    std::vector<uint8_t> rgb(bw * bh * 4);
+    for(const FormatCase& fc : formats)
+    {
+        TestPicture pic{fc, bw, bh, rng};
+        YuvCoeffs k = yuvCoeffs(0.2126, 0.0722, fc.bits, false);
+        std::printf("{\"format\": \"%s\", \"width\": %d, \"height\": %d, \"ms\": {", fc.name, bw, bh);
+        std::printf("\"scalar\": %.3f", time_ms([&] { yuvToRgb(yuvScalarKernels(), pic.img, k, rgb.data(), bw * 4, 0, bh); }, runs));
+        for(const char* name : simd_names)
+        {
+            const YuvKernels* kernels = yuvKernels(name);
+            if(!kernels) continue;
+            std::printf(", \"%s\": %.3f", name, time_ms([&] { yuvToRgb(*kernels, pic.img, k, rgb.data(), bw * 4, 0, bh); }, runs));
+        }
+        SwsContext* sws = sws_open(fc, matrices[1], false, bw, bh);
+        if(sws)
+        {
+            std::printf(", \"sws\": %.3f", time_ms([&] { sws_convert(sws, pic.img, rgb.data(), bw * 4); }, runs));
+            sws_freeContext(sws);
+        }
+        std::printf("}, \"selected\": \"%s\"}\n", yuvKernels().name);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
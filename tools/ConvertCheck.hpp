@@ -0,0 +1,8 @@
+#pragma once
+
+/* Self check of the YUV -> RGB0 kernels on synthetic pictures: every
+ * SIMD kernel set this CPU runs must match the scalar reference bit for
+ * bit, and the distance to sws_scale with the same matrix and range is
+ * reported. Also times each kernel and sws on a 4K picture. Prints JSON
+ * lines, fails when a kernel disagrees with the reference. */
+int runConvertCheck();
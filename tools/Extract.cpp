@@ -0,0 +1,316 @@
+#include "Extract.hpp"
+#include "ImageWriter.hpp"
+#include "../ffmpeg/Decoder.hpp"
+#include "../ffmpeg/KeyframeIndex.hpp"
+#include "../utils/BoundedQueue.hpp"
+#include "../utils/Json.hpp"
+#include "../utils/Trace.hpp"
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// without a complete keyframe index, targets this close are decoded forward rather than seeked to
+const double forward_sec{2.0};
+
+struct Request
+{
+    double time{0.0};
+    std::string out;
+};
+
+struct FileRequests
+{
+    std::string path;
+    std::vector<Request> requests;
+};
+
+struct Image
+{
+    std::string file;
+    std::string out;
+    double time{0.0};
+    double shown{0.0};
+    int width{0};
+    int height{0};
+    std::vector<uint8_t> rgb;  // packed rgb24
+};
+
+struct Counters
+{
+    std::atomic<int> written{0};
+    std::atomic<int> failed{0};
+    std::atomic<int> seeks{0};
+};
+
+std::string base_name(const std::string& path)
+{
+    std::size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// "path seconds", split at the last blank so paths may contain spaces
+bool parse_line(const std::string& line, std::string* path, double* time)
+{
+    std::size_t blank = line.find_last_of(" \t");
+    if(blank == std::string::npos || blank == 0) return false;
+    char* end{nullptr};
+    *time = std::strtod(line.c_str() + blank + 1, &end);
+    if(end == line.c_str() + blank + 1 || *time < 0.0) return false;
+    std::size_t last = line.find_last_not_of(" \t", blank);
+    *path = line.substr(0, last + 1);
+    return true;
+}
+
+bool read_list(const ExtractOptions& opts, std::vector<FileRequests>& files, int* count)
+{
+    std::ifstream in{opts.list};
+    if(!in)
+    {
+        std::cerr << "Couldn't open " << opts.list << "\n";
+        return false;
+    }
+    std::map<std::string, std::size_t> index;
+    std::string line;
+    int n{0};
+    while(std::getline(in, line))
+    {
+        n++;
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        if(line.empty() || line[0] == '#') continue;
+        std::string path;
+        double time;
+        if(!parse_line(line, &path, &time))
+        {
+            std::cerr << opts.list << ":" << n << ": expected \"path seconds\"" << "\n";
+            continue;
+        }
+        auto it = index.find(path);
+        if(it == index.end())
+        {
+            it = index.emplace(path, files.size()).first;
+            files.push_back(FileRequests{path, {}});
+        }
+        files[it->second].requests.push_back(Request{time, ""});
+        (*count)++;
+    }
+
+    // named after the file and the millisecond, numbered when two inputs share a name
+    std::map<std::string, int> names;
+    for(auto& f : files) names[base_name(f.path)]++;
+    for(std::size_t i{0}; i < files.size(); i++)
+    {
+        std::string stem = base_name(files[i].path);
+        if(names[stem] > 1) stem += "~" + std::to_string(i);
+        for(auto& r : files[i].requests)
+        {
+            r.out = opts.out_dir + "/" + stem + "_" + std::to_string(std::llround(r.time * 1000.0)) + (opts.png ? ".png" : ".rgb");
+        }
+        std::stable_sort(files[i].requests.begin(), files[i].requests.end(),
+                         [](const Request& a, const Request& b) { return a.time < b.time; });
+    }
+    return true;
+}
+
+// next frame with a timestamp out of the decoder, false at end of stream or on an error
+bool next_frame(Decoder& dec, Packet& pkt, Frame& frame, int* eof)
+{
+    while(true)
+    {
+        if(dec.receiveFrame(&frame))
+        {
+            if(frame.timeStamp() != AV_NOPTS_VALUE) return true;
+            continue;
+        }
+        if(*eof == 1) return false;
+        if(!dec.readPacket(&pkt))
+        {
+            dec.sendPacket(nullptr, eof);
+            continue;
+        }
+        bool sent = dec.sendPacket(&pkt, eof);
+        pkt.unref();
+        if(!sent) return false;
+    }
+}
+
+std::unique_ptr<Image> to_image(Decoder& dec, Frame* f, FramePool* pool)
+{
+    Frame rgb0;
+    if(!rgb0.allocate(pool, dec.width(), dec.height(), AV_PIX_FMT_RGB0) || !dec.convertFrame(f, &rgb0)) return nullptr;
+    auto img = std::make_unique<Image>();
+    img->width = dec.width();
+    img->height = dec.height();
+    img->rgb.resize(static_cast<std::size_t>(img->width) * img->height * 3);
+    for(int y{0}; y < img->height; y++)
+    {
+        const uint8_t* src = rgb0._data()[0] + static_cast<std::size_t>(y) * rgb0.linesize()[0];
+        uint8_t* dst = img->rgb.data() + static_cast<std::size_t>(y) * img->width * 3;
+        for(int x{0}; x < img->width; x++)
+        {
+            dst[3 * x] = src[4 * x];
+            dst[3 * x + 1] = src[4 * x + 1];
+            dst[3 * x + 2] = src[4 * x + 2];
+        }
+    }
+    return img;
+}
+
+/* All requests of one file, ascending. last is the newest frame at or
+ * before the previous target, next the one after it if already decoded;
+ * the frame shown at t is the last one starting at or before t. */
+void extract_file(const FileRequests& file, const DecoderOptions& dopts, BoundedQueue<std::unique_ptr<Image>>& images,
+                  Counters& counters)
+{
+    VPL_TRACE_SCOPE("extract_file");
+    std::unique_ptr<Decoder> opened = Decoder::tryOpen(file.path, dopts);
+    if(!opened)
+    {
+        // a bad file only fails its own requests, the rest of the batch goes on
+        std::cerr << "Couldn't open " << file.path << ", skipping its " << file.requests.size() << " requests" << "\n";
+        counters.failed += static_cast<int>(file.requests.size());
+        return;
+    }
+    Decoder& dec = *opened;
+    AVRational tb = dec.timeBase();
+    int64_t begin = dec.startTime() != AV_NOPTS_VALUE ? dec.startTime() : 0;
+    FramePool pool{static_cast<std::size_t>(av_image_get_buffer_size(AV_PIX_FMT_RGB0, dec.width(), dec.height(), 64)), 1};
+    Packet pkt;
+    std::unique_ptr<Frame> last, next, spare;
+    int eof{0};
+    for(const Request& r : file.requests)
+    {
+        int64_t t = begin + static_cast<int64_t>(r.time / av_q2d(tb));
+        int64_t pos = next ? next->timeStamp() : last ? last->timeStamp() : AV_NOPTS_VALUE;
+        KeyframeEntry kf;
+        bool forward = pos != AV_NOPTS_VALUE && t >= last->timeStamp() &&
+                       ((dec.keyframes()->complete() && dec.keyframes()->find(t, &kf) && kf.pts <= pos) ||
+                        (t - pos) * av_q2d(tb) <= forward_sec);
+        if(!forward)
+        {
+            dec.seek(t);
+            eof = 0;
+            last.reset();
+            next.reset();
+            counters.seeks++;
+        }
+        while(!next || next->timeStamp() <= t)
+        {
+            if(next)
+            {
+                spare = std::move(last);
+                last = std::move(next);
+            }
+            if(!spare) spare = std::make_unique<Frame>();
+            if(!next_frame(dec, pkt, *spare, &eof)) break;
+            // past t already right after a seek, that first frame is the nearest there is
+            if(!last) last = std::move(spare);
+            else next = std::move(spare);
+            if(last->timeStamp() > t) break;
+        }
+
+        std::unique_ptr<Image> img = last ? to_image(dec, last.get(), &pool) : nullptr;
+        if(!img)
+        {
+            std::cerr << "Couldn't extract " << file.path << " at " << r.time << " s" << "\n";
+            counters.failed++;
+            continue;
+        }
+        img->file = file.path;
+        img->out = r.out;
+        img->time = r.time;
+        img->shown = (last->timeStamp() - begin) * av_q2d(tb);
+        if(!images.push(std::move(img))) return;
+    }
+}
+
+void encode(const ExtractOptions& opts, BoundedQueue<std::unique_ptr<Image>>& images, Counters& counters, std::mutex& out_mtx)
+{
+    VPL_TRACE_THREAD("extract encode");
+    std::unique_ptr<Image> img;
+    while(images.pop(img) && img)
+    {
+        bool ok;
+        if(opts.png)
+        {
+            ok = writePng(img->out, img->rgb.data(), img->width, img->height, img->width * 3);
+        }
+        else
+        {
+            std::ofstream out(img->out, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(img->rgb.data()), img->rgb.size());
+            ok = static_cast<bool>(out);
+            if(!ok) std::cerr << "Couldn't write " << img->out << "\n";
+        }
+        if(!ok)
+        {
+            counters.failed++;
+            continue;
+        }
+        counters.written++;
+        std::lock_guard<std::mutex> lk(out_mtx);
+        std::printf("{\"file\": %s, \"time\": %.3f, \"shown\": %.3f, \"out\": %s, \"width\": %d, \"height\": %d}\n",
+                    jsonString(img->file).c_str(), img->time, img->shown, jsonString(img->out).c_str(), img->width, img->height);
+    }
+}
+}
+
+int runExtract(const ExtractOptions &opts)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<FileRequests> files;
+    int count{0};
+    if(!read_list(opts, files, &count) || files.empty()) return EXIT_FAILURE;
+
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned workers = std::max(std::min<unsigned>(opts.workers > 0 ? opts.workers : cores, files.size()), 1u);
+    unsigned encoders = opts.encoders > 0 ? opts.encoders : std::max(cores / 2, 1u);
+    DecoderOptions dopts;
+    dopts.index_scan = false;
+    dopts.read_mode = opts.read_mode;
+    dopts.read_ahead = opts.read_ahead;
+    dopts.probe = opts.probe;
+    // the decoders already share the cores between them
+    dopts.threads = static_cast<int>(std::max(cores / workers, 1u));
+
+    // a few images per encoder in flight, decoding waits when writing falls behind
+    BoundedQueue<std::unique_ptr<Image>> images{encoders * 4};
+    Counters counters;
+    std::mutex out_mtx;
+    std::vector<std::thread> encode_threads;
+    for(unsigned i{0}; i < encoders; i++)
+        encode_threads.emplace_back(encode, std::cref(opts), std::ref(images), std::ref(counters), std::ref(out_mtx));
+
+    std::atomic<std::size_t> next_file{0};
+    std::vector<std::thread> threads;
+    for(unsigned w{0}; w < workers; w++)
+    {
+        threads.emplace_back([&]
+        {
+            VPL_TRACE_THREAD("extract decode");
+            std::size_t i;
+            while((i = next_file++) < files.size()) extract_file(files[i], dopts, images, counters);
+        });
+    }
+    for(auto& t : threads) t.join();
+    for(unsigned i{0}; i < encoders; i++) images.push(nullptr);
+    for(auto& t : encode_threads) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("{\"files\": %zu, \"requests\": %d, \"written\": %d, \"failed\": %d, \"seeks\": %d, \"workers\": %u, "
+                "\"encoders\": %u, \"seconds\": %.3f, \"frames_per_s\": %.2f}\n",
+                files.size(), count, counters.written.load(), counters.failed.load(), counters.seeks.load(), workers, encoders,
+                seconds, seconds > 0.0 ? counters.written / seconds : 0.0);
+    traceDump(true);
+    return counters.written > 0 && counters.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "../ffmpeg/FileReader.hpp"
+#include "../ffmpeg/StreamInfo.hpp"
+#include <string>
+
+struct ExtractOptions
+{
+    std::string list;          // "path seconds" per line
+    std::string out_dir{"."};
+    bool png{true};            // or raw rgb24
+    unsigned workers{0};       // files decoded at once, 0 for one per core
+    unsigned encoders{0};      // threads writing the images, 0 for half the cores
+    ReadMode read_mode{ReadMode::Auto};
+    std::size_t read_ahead{16 << 20};
+    ProbeOptions probe;
+};
+
+/* Dumps the frames shown at given timestamps of many files. Requests
+ * are grouped by file and sorted, each worker takes a file at a time on
+ * one Decoder and decodes forward from one timestamp to the next when
+ * no keyframe lies between them, seeking otherwise. Converted pictures
+ * are handed to encoder threads writing PNG or raw rgb24. One JSON line
+ * per image and a summary with the throughput go to stdout. */
+int runExtract(const ExtractOptions& opts);
@@ -0,0 +1,53 @@
+#include "ImageWriter.hpp"
+#include <iostream>
+#include <fstream>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+bool writePng(const std::string &path, const uint8_t *rgb, int width, int height, int linesize)
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if(!codec)
+    {
+        std::cerr << "Couldn't find the PNG encoder." << "\n";
+        return false;
+    }
+    AVCodecContext* enc = avcodec_alloc_context3(codec);
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* pkt = av_packet_alloc();
+    bool ok{false};
+    if(enc && frame && pkt)
+    {
+        enc->width = width;
+        enc->height = height;
+        enc->pix_fmt = AV_PIX_FMT_RGB24;
+        enc->time_base = AVRational{1, 25};
+        // the encoder copies the picture, it doesn't have to be refcounted
+        frame->data[0] = const_cast<uint8_t*>(rgb);
+        frame->linesize[0] = linesize;
+        frame->width = width;
+        frame->height = height;
+        frame->format = AV_PIX_FMT_RGB24;
+        ok = avcodec_open2(enc, codec, nullptr) == 0 && avcodec_send_frame(enc, frame) == 0 &&
+             avcodec_send_frame(enc, nullptr) == 0 && avcodec_receive_packet(enc, pkt) == 0;
+    }
+    if(ok)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
+        ok = static_cast<bool>(out);
+        if(!ok) std::cerr << "Couldn't write " << path << "\n";
+    }
+    else
+    {
+        std::cerr << "Couldn't encode " << path << "\n";
+    }
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    return ok;
+}
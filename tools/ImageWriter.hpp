@@ -0,0 +1,7 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+/* Encodes a packed RGB24 picture with ffmpeg's PNG encoder and writes
+ * it to path. False (with a message) when encoding or writing fails. */
+bool writePng(const std::string& path, const uint8_t* rgb, int width, int height, int linesize);
@@ -0,0 +1,115 @@
+#include "LibraryProbe.hpp"
+#include "../ffmpeg/Decoder.hpp"
+#include "../utils/Json.hpp"
+#include "../utils/Trace.hpp"
+#include <vector>
+#include <set>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace
+{
+// regular files under dir, hidden ones left out, sorted so runs compare line by line;
+// symlinks are followed but each directory is walked once, so a link to a parent doesn't loop
+void list_files(const std::string& dir, std::vector<std::string>& files, std::set<std::pair<dev_t, ino_t>>& visited)
+{
+    struct stat ds;
+    if(stat(dir.c_str(), &ds) != 0 || !visited.insert({ds.st_dev, ds.st_ino}).second) return;
+    DIR* d = opendir(dir.c_str());
+    if(!d)
+    {
+        std::cerr << "Couldn't open directory " << dir << "\n";
+        return;
+    }
+    std::vector<std::string> subdirs;
+    while(dirent* e = readdir(d))
+    {
+        if(e->d_name[0] == '.') continue;
+        std::string path = dir + "/" + e->d_name;
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0) continue;
+        if(S_ISDIR(st.st_mode)) subdirs.push_back(path);
+        else if(S_ISREG(st.st_mode)) files.push_back(path);
+    }
+    closedir(d);
+    for(const auto& s : subdirs) list_files(s, files, visited);
+}
+
+std::string probe_line(const std::string& path, const LibraryProbeOptions& opts, bool* ok)
+{
+    ProbeOptions probe = opts.probe;
+    probe.save = opts.write_cache;
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<FormatContext> fmt = FormatContext::tryOpen(path, opts.read_mode, opts.read_ahead, probe);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    char line[512];
+    AVStream* video = fmt ? fmt->video_ID() : nullptr;
+    *ok = video != nullptr;
+    if(!video)
+    {
+        std::snprintf(line, sizeof(line), ", \"error\": \"%s\", \"ms\": %.2f}", fmt ? "no video stream" : "couldn't open", ms);
+        return "{\"file\": " + jsonString(path) + line;
+    }
+    int64_t duration = fmt->duration();
+    double fps = fmt->fps();
+    if(!(fps > 0.0)) fps = 0.0;  // 0/0 when the container doesn't say
+    std::snprintf(line, sizeof(line), ", \"format\": %s, \"codec\": %s, \"width\": %d, \"height\": %d, \"fps\": %.3f, "
+                  "\"duration\": %.3f, \"audio\": %s, \"cached\": %s, \"ms\": %.2f}",
+                  jsonString(fmt->self()->iformat->name).c_str(), jsonString(avcodec_get_name(video->codecpar->codec_id)).c_str(),
+                  video->codecpar->width, video->codecpar->height, fps,
+                  duration != AV_NOPTS_VALUE ? duration / static_cast<double>(AV_TIME_BASE) : -1.0,
+                  fmt->audioID() ? "true" : "false", fmt->infoCached() ? "true" : "false", ms);
+    return "{\"file\": " + jsonString(path) + line;
+}
+}
+
+int runLibraryProbe(const LibraryProbeOptions &opts)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    std::set<std::pair<dev_t, ino_t>> visited;
+    list_files(opts.dir, files, visited);
+    std::sort(files.begin(), files.end());
+    if(files.empty()) return EXIT_FAILURE;
+
+    // mostly waiting on the disk, so more files in flight than cores
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned workers = std::max(std::min<unsigned>(opts.workers > 0 ? opts.workers : 2 * cores, files.size()), 1u);
+    std::atomic<std::size_t> next{0};
+    std::atomic<int> failed{0};
+    std::mutex out_mtx;
+    std::vector<std::thread> threads;
+    for(unsigned w{0}; w < workers; w++)
+    {
+        threads.emplace_back([&]
+        {
+            VPL_TRACE_THREAD("probe");
+            std::size_t i;
+            while((i = next++) < files.size())
+            {
+                bool ok;
+                std::string line = probe_line(files[i], opts, &ok);
+                if(!ok) failed++;
+                std::lock_guard<std::mutex> lk(out_mtx);
+                std::printf("%s\n", line.c_str());
+                std::fflush(stdout);
+            }
+        });
+    }
+    for(auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("{\"dir\": %s, \"files\": %zu, \"failed\": %d, \"workers\": %u, \"seconds\": %.3f, \"files_per_s\": %.2f}\n",
+                jsonString(opts.dir).c_str(), files.size(), failed.load(), workers, seconds,
+                seconds > 0.0 ? files.size() / seconds : 0.0);
+    traceDump(true);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "../ffmpeg/FileReader.hpp"
+#include "../ffmpeg/StreamInfo.hpp"
+#include <string>
+
+struct LibraryProbeOptions
+{
+    std::string dir;
+    unsigned workers{0};                  // files opened at once, 0 for two per core
+    ReadMode read_mode{ReadMode::Ffmpeg};  // a read-ahead thread per file doesn't pay for a few headers
+    std::size_t read_ahead{1 << 20};
+    ProbeOptions probe;
+    bool write_cache{false};              // a scan only reads, sidecars for the whole library on request
+};
+
+/* Walks dir recursively and opens every file with FormatContext alone,
+ * no decoder, under the probe limits and stream info cache, on a
+ * number of threads at once. The cache is only read unless
+ * write_cache is set. Streams a JSON line per file to stdout as
+ * it is done, duration, fps, size and codec or the error, then a
+ * summary with files per second. */
+int runLibraryProbe(const LibraryProbeOptions& opts);
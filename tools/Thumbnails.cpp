@@ -0,0 +1,201 @@
+#include "Thumbnails.hpp"
+#include "ImageWriter.hpp"
+#include "../ffmpeg/Decoder.hpp"
+#include "../ffmpeg/KeyframeIndex.hpp"
+#include "../utils/Json.hpp"
+#include "../utils/Trace.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+struct Thumb
+{
+    int64_t target{0};              // stream pts the thumbnail stands for
+    int64_t pts{AV_NOPTS_VALUE};    // keyframe actually shown
+};
+
+struct Sheet
+{
+    int tile_w{0};
+    int tile_h{0};
+    int columns{0};
+    int width{0};
+    int height{0};
+    std::vector<uint8_t> rgb;
+    uint8_t* tile(int i)
+    {
+        return rgb.data() + (i / columns) * tile_h * width * 3 + (i % columns) * tile_w * 3;
+    }
+};
+
+// the first frame the decoder gives back after a seek, keyframes only
+bool decode_keyframe(Decoder& dec, Packet& pkt, Frame& frame)
+{
+    int eof{0};
+    while(true)
+    {
+        if(dec.receiveFrame(&frame)) return true;
+        if(eof == 1) return false;
+        if(!dec.readPacket(&pkt))
+        {
+            dec.sendPacket(nullptr, &eof);
+            continue;
+        }
+        bool sent = dec.sendPacket(&pkt, &eof);
+        pkt.unref();
+        if(!sent) return false;
+    }
+}
+
+void copy_tile(Sheet& sheet, int from, int to)
+{
+    for(int y{0}; y < sheet.tile_h; y++)
+        std::memcpy(sheet.tile(to) + y * sheet.width * 3, sheet.tile(from) + y * sheet.width * 3, sheet.tile_w * 3);
+}
+
+/* Thumbnails [begin, end) on one Decoder, opened here unless handed
+ * one. Targets ascend, so every seek goes forward; targets whose
+ * keyframe is already on the sheet copy that tile instead of being
+ * scaled again. */
+void render_slice(std::unique_ptr<Decoder> dec, const ThumbnailOptions& opts, const DecoderOptions& dopts,
+                  std::vector<Thumb>& thumbs, int begin, int end, Sheet& sheet, std::atomic<int>& failed)
+{
+    VPL_TRACE_THREAD("thumbnails");
+    if(!dec) dec = std::make_unique<Decoder>(opts.file, dopts);
+    dec->keyframesOnly(true);
+    Packet pkt;
+    Frame frame;
+    SwsContext* sws{nullptr};
+    int last{-1};
+    for(int i{begin}; i < end; i++)
+    {
+        // only a complete index can tell without seeking, a partial one just knows the keyframes read so far
+        KeyframeEntry kf;
+        if(last >= 0 && dec->keyframes()->complete() && dec->keyframes()->find(thumbs[i].target, &kf) &&
+           kf.pts == thumbs[last].pts)
+        {
+            copy_tile(sheet, last, i);
+            thumbs[i].pts = thumbs[last].pts;
+            continue;
+        }
+        dec->seek(thumbs[i].target);
+        if(!decode_keyframe(*dec, pkt, frame))
+        {
+            failed++;
+            continue;
+        }
+        if(last >= 0 && frame.timeStamp() == thumbs[last].pts)
+        {
+            copy_tile(sheet, last, i);
+            thumbs[i].pts = thumbs[last].pts;
+            frame.unref();
+            continue;
+        }
+        sws = sws_getCachedContext(sws, frame.width(), frame.height(), frame.format(), sheet.tile_w, sheet.tile_h,
+                                   AV_PIX_FMT_RGB24, SWS_AREA, nullptr, nullptr, nullptr);
+        uint8_t* dst[4]{sheet.tile(i), nullptr, nullptr, nullptr};
+        int dst_ln[4]{sheet.width * 3, 0, 0, 0};
+        if(!sws || sws_scale(sws, frame._data(), frame.linesize(), 0, frame.height(), dst, dst_ln) < 0)
+        {
+            failed++;
+            frame.unref();
+            continue;
+        }
+        thumbs[i].pts = frame.timeStamp();
+        frame.unref();
+        last = i;
+    }
+    sws_freeContext(sws);
+}
+
+std::string base_name(const std::string& path)
+{
+    std::size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+}
+
+int runThumbnails(const ThumbnailOptions &opts)
+{
+    if(opts.count <= 0) return EXIT_FAILURE;
+    auto start = std::chrono::steady_clock::now();
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    int workers = static_cast<int>(std::min<unsigned>(opts.workers > 0 ? opts.workers : cores, opts.count));
+    workers = std::max(workers, 1);
+
+    DecoderOptions dopts;
+    dopts.index_scan = false;
+    dopts.read_mode = opts.read_mode;
+    dopts.read_ahead = opts.read_ahead;
+    dopts.probe = opts.probe;
+    // the decoders already share the cores between them
+    dopts.threads = static_cast<int>(std::max(cores / workers, 1u));
+    auto first = std::make_unique<Decoder>(opts.file, dopts);
+
+    Sheet sheet;
+    sheet.tile_w = std::max(opts.tile_width, 2) & ~1;
+    sheet.tile_h = std::max(static_cast<int>(static_cast<int64_t>(sheet.tile_w) * first->height() / std::max(first->width(), 1)), 2) & ~1;
+    sheet.columns = std::max(std::min(opts.columns, opts.count), 1);
+    sheet.width = sheet.tile_w * sheet.columns;
+    sheet.height = sheet.tile_h * ((opts.count + sheet.columns - 1) / sheet.columns);
+    sheet.rgb.assign(static_cast<std::size_t>(sheet.width) * sheet.height * 3, 0);
+
+    // evenly spaced, each in the middle of its share of the timeline
+    AVRational tb = first->timeBase();
+    int64_t begin = first->startTime() != AV_NOPTS_VALUE ? first->startTime() : 0;
+    int64_t dur_ms = std::max<int64_t>(first->duration(), 0);
+    std::vector<Thumb> thumbs(opts.count);
+    for(int i{0}; i < opts.count; i++)
+        thumbs[i].target = begin + av_rescale_q((2 * i + 1) * dur_ms / (2 * opts.count), AVRational{1, 1000}, tb);
+
+    std::atomic<int> failed{0};
+    std::vector<std::thread> threads;
+    for(int w{1}; w < workers; w++)
+    {
+        threads.emplace_back(render_slice, nullptr, std::cref(opts), std::cref(dopts), std::ref(thumbs), w * opts.count / workers,
+                             (w + 1) * opts.count / workers, std::ref(sheet), std::ref(failed));
+    }
+    render_slice(std::move(first), opts, dopts, thumbs, 0, opts.count / workers, sheet, failed);
+    for(auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string sprite = opts.out.empty() ? base_name(opts.file) + ".sprite.png" : opts.out;
+    std::string stem = sprite.size() > 4 && sprite.compare(sprite.size() - 4, 4, ".png") == 0 ? sprite.substr(0, sprite.size() - 4) : sprite;
+    std::string index = stem + ".json";
+    bool ok = writePng(sprite, sheet.rgb.data(), sheet.width, sheet.height, sheet.width * 3);
+
+    std::ofstream out(index, std::ios::trunc);
+    out << "{\"file\": " << jsonString(opts.file) << ", \"sprite\": " << jsonString(base_name(sprite)) << ", \"width\": "
+        << sheet.width << ", \"height\": " << sheet.height << ", \"tile_width\": " << sheet.tile_w << ", \"tile_height\": "
+        << sheet.tile_h << ", \"columns\": " << sheet.columns << ", \"thumbnails\": [";
+    for(int i{0}; i < opts.count; i++)
+    {
+        const Thumb& t = thumbs[i];
+        char line[160];
+        std::snprintf(line, sizeof(line), "%s\n  {\"time\": %.3f, \"shown\": %.3f, \"x\": %d, \"y\": %d}", i ? "," : "",
+                      (t.target - begin) * av_q2d(tb), t.pts != AV_NOPTS_VALUE ? (t.pts - begin) * av_q2d(tb) : -1.0,
+                      (i % sheet.columns) * sheet.tile_w, (i / sheet.columns) * sheet.tile_h);
+        out << line;
+    }
+    out << "\n]}\n";
+    if(!out)
+    {
+        std::cerr << "Couldn't write " << index << "\n";
+        ok = false;
+    }
+
+    std::printf("{\"file\": %s, \"sprite\": %s, \"index\": %s, \"thumbnails\": %d, \"failed\": %d, \"workers\": %d, "
+                "\"seconds\": %.3f, \"thumbs_per_s\": %.2f}\n",
+                jsonString(opts.file).c_str(), jsonString(sprite).c_str(), jsonString(index).c_str(), opts.count, failed.load(),
+                workers, seconds, seconds > 0.0 ? opts.count / seconds : 0.0);
+    traceDump(true);
+    return ok && failed < opts.count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
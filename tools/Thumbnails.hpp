@@ -0,0 +1,25 @@
+#pragma once
+#include "../ffmpeg/FileReader.hpp"
+#include "../ffmpeg/StreamInfo.hpp"
+#include <string>
+
+struct ThumbnailOptions
+{
+    std::string file;
+    std::string out;           // sprite PNG, the index goes next to it as .json; empty names both after the file
+    int count{100};
+    int tile_width{160};       // the height follows the aspect ratio
+    int columns{10};
+    unsigned workers{0};       // decoders running at once, 0 for one per core
+    ReadMode read_mode{ReadMode::Auto};
+    std::size_t read_ahead{16 << 20};
+    ProbeOptions probe;
+};
+
+/* Seek bar preview sprites: count thumbnails evenly spaced over the
+ * file, laid out row by row in one PNG, plus a JSON index from each
+ * timestamp to its tile. Every worker opens its own Decoder on a
+ * contiguous slice of the timeline and decodes keyframes only, so
+ * there is one seek and one keyframe decode per thumbnail. Prints a
+ * JSON summary with the throughput on stdout. */
+int runThumbnails(const ThumbnailOptions& opts);
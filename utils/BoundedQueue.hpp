@@ -0,0 +1,141 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+struct QueueStats
+{
+    std::size_t depth{0};
+    std::size_t peak{0};
+    std::size_t capacity{0};
+    double push_blocked_ms{0.0};
+    double pop_blocked_ms{0.0};
+};
+
+/* Fixed capacity FIFO shared between two pipeline stages.
+ * push() blocks while the queue is full and pop() while it is empty;
+ * the time spent blocked on each side is accumulated so a starving or
+ * stalling stage can be spotted. abort() wakes every waiter and makes
+ * blocking calls fail until reset(); a failed push() leaves the item
+ * with the caller. */
+template<typename T>
+class BoundedQueue
+{
+private:
+    std::deque<T> items_;
+    std::size_t capacity_;
+    std::size_t peak_{0};
+    bool aborted_{false};
+    mutable std::mutex mtx_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::atomic<int64_t> push_blocked_ns_{0};
+    std::atomic<int64_t> pop_blocked_ns_{0};
+
+    static int64_t since(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+    }
+public:
+    explicit BoundedQueue(std::size_t capacity): capacity_{capacity ? capacity : 1} {}
+
+    bool push(T&& item)
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        if(items_.size() >= capacity_ && !aborted_)
+        {
+            auto t = std::chrono::steady_clock::now();
+            not_full_.wait(lk, [this]{ return items_.size() < capacity_ || aborted_; });
+            push_blocked_ns_ += since(t);
+        }
+        if(aborted_) return false;
+        items_.push_back(std::move(item));
+        if(items_.size() > peak_) peak_ = items_.size();
+        lk.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        if(items_.empty() && !aborted_)
+        {
+            auto t = std::chrono::steady_clock::now();
+            not_empty_.wait(lk, [this]{ return !items_.empty() || aborted_; });
+            pop_blocked_ns_ += since(t);
+        }
+        if(aborted_) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        lk.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+
+    /* Non blocking pop, also works on an aborted queue so it can be drained. */
+    bool tryPop(T& item)
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        if(items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        lk.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+
+    /* True once there is an item to pop or the queue was aborted, false
+     * if timeout passes first. Takes nothing, for a consumer that has to
+     * keep an eye on something else while it waits. */
+    bool waitFor(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        return not_empty_.wait_for(lk, timeout, [this]{ return !items_.empty() || aborted_; });
+    }
+
+    void abort()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            aborted_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        aborted_ = false;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        items_.clear();
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        return items_.size();
+    }
+
+    QueueStats stats() const
+    {
+        QueueStats s;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            s.depth = items_.size();
+            s.peak = peak_;
+        }
+        s.capacity = capacity_;
+        s.push_blocked_ms = push_blocked_ns_.load() / 1e6;
+        s.pop_blocked_ms = pop_blocked_ns_.load() / 1e6;
+        return s;
+    }
+};
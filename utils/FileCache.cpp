@@ -0,0 +1,39 @@
+#include "FileCache.hpp"
+#include <cstdlib>
+#include <climits>
+#include <functional>
+#include <sstream>
+#include <sys/stat.h>
+
+static bool make_dir(const std::string& dir)
+{
+    struct stat st;
+    if(stat(dir.c_str(), &st) == 0) return S_ISDIR(st.st_mode);
+    return mkdir(dir.c_str(), 0755) == 0;
+}
+
+bool fileStamp(const std::string &path, int64_t *size, int64_t *mtime)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) return false;
+    *size = static_cast<int64_t>(st.st_size);
+    *mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+std::string cacheFile(const std::string &path, const std::string &ext)
+{
+    std::string base;
+    if(const char* xdg = std::getenv("XDG_CACHE_HOME")) base = xdg;
+    else if(const char* home = std::getenv("HOME")) base = std::string(home) + "/.cache";
+    else return "";
+    if(!make_dir(base)) return "";
+    base += "/vpl";
+    if(!make_dir(base)) return "";
+
+    char full[PATH_MAX];
+    std::string key = realpath(path.c_str(), full) ? std::string(full) : path;
+    std::ostringstream name;
+    name << base << "/" << std::hex << std::hash<std::string>()(key) << ext;
+    return name.str();
+}
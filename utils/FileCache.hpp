@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+/* Size and modification time of a file, used to tell whether a cached
+ * sidecar still describes it. */
+bool fileStamp(const std::string& path, int64_t* size, int64_t* mtime);
+
+/* Path of the cache file with extension ext for the media file path,
+ * under $XDG_CACHE_HOME/vpl (or ~/.cache/vpl). Empty when no cache
+ * directory can be created. */
+std::string cacheFile(const std::string& path, const std::string& ext);
@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <cstdio>
+
+/* Quoted JSON string literal for s. */
+inline std::string jsonString(const std::string& s)
+{
+    std::string out{"\""};
+    for(char c : s)
+    {
+        switch(c)
+        {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if(static_cast<unsigned char>(c) < 0x20)
+            {
+                char esc[8];
+                std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out += esc;
+            }
+            else out += c;
+        }
+    }
+    out += "\"";
+    return out;
+}
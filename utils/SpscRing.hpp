@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/* Lock free ring for exactly one producer and one consumer thread.
+ * Neither side ever locks or allocates, which makes it usable from a
+ * real time audio callback. Capacity is rounded up to a power of two. */
+template<typename T>
+class SpscRing
+{
+private:
+    std::vector<T> buf_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> head_{0};  // next slot the producer writes
+    alignas(64) std::atomic<std::size_t> tail_{0};  // next slot the consumer reads
+
+    static std::size_t round_up(std::size_t n)
+    {
+        std::size_t p{1};
+        while(p < n) p <<= 1;
+        return p;
+    }
+public:
+    explicit SpscRing(std::size_t capacity):
+        buf_(round_up(capacity ? capacity : 1)),
+        mask_{buf_.size() - 1}
+    {}
+
+    std::size_t capacity() const { return buf_.size(); }
+
+    // producer side
+    std::size_t writable() const
+    {
+        return buf_.size() - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire));
+    }
+
+    std::size_t write(const T* data, std::size_t n)
+    {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        std::size_t room = buf_.size() - (head - tail_.load(std::memory_order_acquire));
+        if(n > room) n = room;
+        for(std::size_t i{0}; i < n; i++) buf_[(head + i) & mask_] = data[i];
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    bool push(const T& item)
+    {
+        return write(&item, 1) == 1;
+    }
+
+    // consumer side
+    std::size_t readable() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+    }
+
+    std::size_t read(T* data, std::size_t n)
+    {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t avail = head_.load(std::memory_order_acquire) - tail;
+        if(n > avail) n = avail;
+        for(std::size_t i{0}; i < n; i++) data[i] = buf_[(tail + i) & mask_];
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    const T* front() const
+    {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if(head_.load(std::memory_order_acquire) == tail) return nullptr;
+        return &buf_[tail & mask_];
+    }
+
+    bool pop()
+    {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if(head_.load(std::memory_order_acquire) == tail) return false;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t discard()
+    {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        std::size_t head = head_.load(std::memory_order_acquire);
+        tail_.store(head, std::memory_order_release);
+        return head - tail;
+    }
+};
@@ -0,0 +1,135 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    threads = std::max(threads, 1u);
+    for(unsigned i{0}; i < threads; i++) queues_.emplace_back(new Worker);
+    for(unsigned i{0}; i < threads; i++) threads_.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lk(wake_mtx_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for(auto& t : threads_) t.join();
+}
+
+unsigned ThreadPool::size()
+{
+    return static_cast<unsigned>(threads_.size());
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool{std::max(std::thread::hardware_concurrency(), 2u) - 1};
+    return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    Worker& w = *queues_[next_++ % queues_.size()];
+    {
+        std::lock_guard<std::mutex> lk(w.mtx);
+        w.tasks.push_back(std::move(task));
+    }
+    {
+        // under the wake lock so a worker about to sleep can't miss it
+        std::lock_guard<std::mutex> lk(wake_mtx_);
+        pending_++;
+    }
+    wake_.notify_one();
+}
+
+// own deque from the back first, then steal from the front of the others
+bool ThreadPool::take(std::size_t self, std::function<void()> &task)
+{
+    std::size_t n = queues_.size();
+    for(std::size_t i{0}; i < n; i++)
+    {
+        Worker& w = *queues_[(self + i) % n];
+        std::lock_guard<std::mutex> lk(w.mtx);
+        if(w.tasks.empty()) continue;
+        if(i == 0)
+        {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+        }
+        pending_--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t self)
+{
+    std::function<void()> task;
+    while(true)
+    {
+        if(take(self, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(wake_mtx_);
+        wake_.wait(lk, [this] { return stop_ || pending_ > 0; });
+        if(stop_) return;
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &fn)
+{
+    if(count <= 0) return;
+    if(count == 1)
+    {
+        fn(0);
+        return;
+    }
+    struct Latch
+    {
+        std::mutex mtx;
+        std::condition_variable done;
+        int left;
+    };
+    auto latch = std::make_shared<Latch>();
+    latch->left = count - 1;
+    for(int i{1}; i < count; i++)
+    {
+        submit([latch, &fn, i]
+        {
+            fn(i);
+            std::lock_guard<std::mutex> lk(latch->mtx);
+            if(--latch->left == 0) latch->done.notify_all();
+        });
+    }
+    fn(0);
+
+    // help out instead of idling, the tasks left may well be our own
+    std::function<void()> task;
+    std::size_t self = next_ % queues_.size();
+    while(true)
+    {
+        {
+            std::lock_guard<std::mutex> lk(latch->mtx);
+            if(latch->left == 0) return;
+        }
+        if(take(self, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(latch->mtx);
+        latch->done.wait(lk, [&] { return latch->left == 0; });
+        return;
+    }
+}
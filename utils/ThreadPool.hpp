@@ -0,0 +1,44 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/* Persistent worker threads with one task deque each. submit() deals
+ * tasks round robin; a worker takes from the back of its own deque and
+ * steals from the front of the others when it runs dry, so uneven
+ * tasks even out without a central queue. parallelFor() blocks until
+ * all its tasks are done and runs tasks itself while waiting, which
+ * keeps it safe to call from inside a task. */
+class ThreadPool
+{
+private:
+    struct Worker
+    {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<Worker>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex wake_mtx_;
+    std::condition_variable wake_;
+    std::atomic<long> pending_{0};  // may dip below zero while a submit is half done
+    std::atomic<unsigned> next_{0};
+    bool stop_{false};
+    bool take(std::size_t self, std::function<void()>& task);
+    void run(std::size_t self);
+public:
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    void submit(std::function<void()> task);
+    void parallelFor(int count, const std::function<void(int)>& fn);
+    unsigned size();
+    // one pool for the whole process, a thread per core besides the caller
+    static ThreadPool& shared();
+};
@@ -0,0 +1,167 @@
+#include "Trace.hpp"
+
+#ifdef VPL_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Json.hpp"
+
+struct TraceEvent
+{
+    const char* name;
+    int64_t begin;
+    int64_t dur;
+};
+
+/* Filled only by the owning thread; count is published with release so
+ * the exporter sees complete events without locking. */
+struct TraceChunk
+{
+    static const std::size_t capacity = 4096;
+    TraceEvent events[capacity];
+    std::atomic<std::size_t> count{0};
+    std::atomic<TraceChunk*> next{nullptr};
+};
+
+struct TraceBuffer
+{
+    static const std::size_t max_chunks = 256;
+    int tid{0};
+    std::string name;
+    TraceChunk head;
+    TraceChunk* tail{&head};
+    std::size_t chunks{1};
+    std::atomic<uint64_t> dropped{0};
+    ~TraceBuffer()
+    {
+        TraceChunk* c = head.next.load();
+        while(c)
+        {
+            TraceChunk* n = c->next.load();
+            delete c;
+            c = n;
+        }
+    }
+};
+
+static std::mutex registry_mtx;
+static std::vector<std::unique_ptr<TraceBuffer>> registry;
+static thread_local TraceBuffer* local_buffer{nullptr};
+static volatile std::sig_atomic_t dump_requested{0};
+static const auto trace_epoch = std::chrono::steady_clock::now();
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+static TraceBuffer* buffer()
+{
+    if(!local_buffer)
+    {
+        std::lock_guard<std::mutex> lk(registry_mtx);
+        registry.emplace_back(new TraceBuffer);
+        local_buffer = registry.back().get();
+        local_buffer->tid = static_cast<int>(registry.size());
+    }
+    return local_buffer;
+}
+
+TraceScope::TraceScope(const char *name):
+    name_{name},
+    begin_{now_ns()}
+{}
+
+TraceScope::~TraceScope()
+{
+    int64_t end = now_ns();
+    TraceBuffer* b = buffer();
+    TraceChunk* c = b->tail;
+    std::size_t n = c->count.load(std::memory_order_relaxed);
+    if(n == TraceChunk::capacity)
+    {
+        if(b->chunks == TraceBuffer::max_chunks)
+        {
+            b->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        TraceChunk* fresh = new TraceChunk;
+        c->next.store(fresh, std::memory_order_release);
+        b->tail = c = fresh;
+        b->chunks++;
+        n = 0;
+    }
+    c->events[n] = TraceEvent{name_, begin_, end - begin_};
+    c->count.store(n + 1, std::memory_order_release);
+}
+
+void traceThreadName(const char *name)
+{
+    TraceBuffer* b = buffer();
+    std::lock_guard<std::mutex> lk(registry_mtx);
+    b->name = name;
+}
+
+static void on_signal(int)
+{
+    dump_requested = 1;
+}
+
+void traceInit()
+{
+    std::signal(SIGUSR1, on_signal);
+}
+
+bool traceDump(bool force)
+{
+    if(!force && !dump_requested) return false;
+    dump_requested = 0;
+
+    const char* env = std::getenv("VPL_TRACE_FILE");
+    std::string path = env ? env : "vpl-trace.json";
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if(!out)
+    {
+        std::cerr << "Couldn't write trace file " << path << "\n";
+        return false;
+    }
+
+    uint64_t dropped{0};
+    bool first{true};
+    std::fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    std::lock_guard<std::mutex> lk(registry_mtx);
+    for(const auto& b : registry)
+    {
+        std::string name = b->name.empty() ? "thread " + std::to_string(b->tid) : b->name;
+        std::fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": %s}}",
+                     first ? "" : ",\n", b->tid, jsonString(name).c_str());
+        first = false;
+        for(const TraceChunk* c = &b->head; c; c = c->next.load(std::memory_order_acquire))
+        {
+            std::size_t n = c->count.load(std::memory_order_acquire);
+            for(std::size_t i{0}; i < n; i++)
+            {
+                const TraceEvent& e = c->events[i];
+                std::fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                             e.name, b->tid, e.begin / 1000.0, e.dur / 1000.0);
+            }
+        }
+        dropped += b->dropped.load(std::memory_order_relaxed);
+    }
+    std::fprintf(out, "\n]}\n");
+    std::fclose(out);
+    std::cerr << "Trace written to " << path;
+    if(dropped) std::cerr << " (" << dropped << " events dropped)";
+    std::cerr << "\n";
+    return true;
+}
+
+#endif
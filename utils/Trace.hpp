@@ -0,0 +1,44 @@
+#pragma once
+
+/* Hot path trace points, compiled in only with -DVPL_TRACE=ON.
+ *
+ * VPL_TRACE_SCOPE("name") times the rest of the enclosing block into a
+ * buffer owned by the calling thread, so recording never takes a lock.
+ * traceDump() writes everything recorded so far as Chrome trace event
+ * JSON (chrome://tracing, ui.perfetto.dev) to $VPL_TRACE_FILE, default
+ * vpl-trace.json: always when force is set, otherwise only after a
+ * SIGUSR1 arrived. Without VPL_TRACE all of it compiles to nothing.
+ * Scope names must be string literals. */
+
+#ifdef VPL_TRACE
+
+#include <cstdint>
+
+class TraceScope
+{
+private:
+    const char* name_;
+    int64_t begin_;
+public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+};
+
+void traceThreadName(const char* name);
+void traceInit();
+bool traceDump(bool force);
+
+#define VPL_TRACE_CONCAT2(a, b) a##b
+#define VPL_TRACE_CONCAT(a, b) VPL_TRACE_CONCAT2(a, b)
+#define VPL_TRACE_SCOPE(name) TraceScope VPL_TRACE_CONCAT(trace_scope_, __LINE__){name}
+#define VPL_TRACE_THREAD(name) traceThreadName(name)
+
+#else
+
+inline void traceInit() {}
+inline bool traceDump(bool) { return false; }
+
+#define VPL_TRACE_SCOPE(name) do {} while(0)
+#define VPL_TRACE_THREAD(name) do {} while(0)
+
+#endif
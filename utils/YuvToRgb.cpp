@@ -0,0 +1,100 @@
+#include "YuvToRgbKernels.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+YuvCoeffs yuvCoeffs(double kr, double kb, int bits, bool full_range)
+{
+    double kg = 1.0 - kr - kb;
+    double depth = static_cast<double>(1 << (bits - 8));
+    double sy = full_range ? 255.0 / ((1 << bits) - 1) : 255.0 / (219.0 * depth);
+    double sc = full_range ? 255.0 / ((1 << bits) - 1) : 255.0 / (224.0 * depth);
+    auto fixed = [](double x) { return static_cast<int32_t>(std::lround(x * (1 << 14))); };
+    YuvCoeffs k;
+    k.y_offset = full_range ? 0 : 16 << (bits - 8);
+    k.c_offset = 128 << (bits - 8);
+    k.y = fixed(sy);
+    k.r_v = fixed(2.0 * (1.0 - kr) * sc);
+    k.g_u = fixed(2.0 * (1.0 - kb) * kb / kg * sc);
+    k.g_v = fixed(2.0 * (1.0 - kr) * kr / kg * sc);
+    k.b_u = fixed(2.0 * (1.0 - kb) * sc);
+    return k;
+}
+
+void yuv420pRowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int begin, int end,
+                      const YuvCoeffs &k)
+{
+    for(int x{begin}; x < end; x++)
+        yuv_pixel(y[x], u[x >> 1], v[x >> 1], k, dst + 4 * x);
+}
+
+void nv12RowScalar(const uint8_t *y, const uint8_t *uv, const uint8_t *unused, uint8_t *dst, int begin, int end,
+                   const YuvCoeffs &k)
+{
+    for(int x{begin}; x < end; x++)
+        yuv_pixel(y[x], uv[x & ~1], uv[x | 1], k, dst + 4 * x);
+}
+
+void yuv420p10RowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int begin, int end,
+                        const YuvCoeffs &k)
+{
+    const uint16_t* y16 = reinterpret_cast<const uint16_t*>(y);
+    const uint16_t* u16 = reinterpret_cast<const uint16_t*>(u);
+    const uint16_t* v16 = reinterpret_cast<const uint16_t*>(v);
+    for(int x{begin}; x < end; x++)
+        yuv_pixel(y16[x], u16[x >> 1], v16[x >> 1], k, dst + 4 * x);
+}
+
+static const YuvKernels scalar_kernels{"scalar", {yuv420pRowScalar, nv12RowScalar, yuv420p10RowScalar}};
+
+const YuvKernels &yuvScalarKernels()
+{
+    return scalar_kernels;
+}
+
+const YuvKernels *yuvKernels(const char *name)
+{
+    if(std::strcmp(name, "scalar") == 0) return &scalar_kernels;
+#ifdef VPL_X86_SIMD
+    __builtin_cpu_init();
+    if(std::strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f")) return &yuv_kernels_avx512;
+    if(std::strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return &yuv_kernels_avx2;
+    if(std::strcmp(name, "sse4.1") == 0 && __builtin_cpu_supports("sse4.1")) return &yuv_kernels_sse41;
+#endif
+    return nullptr;
+}
+
+static const YuvKernels* pick_kernels()
+{
+    if(const char* env = std::getenv("VPL_SIMD"))
+    {
+        if(const YuvKernels* k = yuvKernels(env)) return k;
+        std::cerr << "Couldn't use VPL_SIMD=" << env << ", not supported here." << "\n";
+    }
+    for(const char* name : {"avx512", "avx2", "sse4.1"})
+    {
+        if(const YuvKernels* k = yuvKernels(name)) return k;
+    }
+    return &scalar_kernels;
+}
+
+const YuvKernels &yuvKernels()
+{
+    static const YuvKernels* best = pick_kernels();
+    return *best;
+}
+
+void yuvToRgb(const YuvKernels &kernels, const YuvImage &src, const YuvCoeffs &k, uint8_t *dst, int dst_linesize,
+              int row_begin, int row_end)
+{
+    YuvRowFn row = kernels.row[static_cast<int>(src.format)];
+    for(int r{row_begin}; r < row_end; r++)
+    {
+        int c = r >> 1;
+        const uint8_t* y = src.data[0] + static_cast<std::ptrdiff_t>(r) * src.linesize[0];
+        const uint8_t* u = src.data[1] + static_cast<std::ptrdiff_t>(c) * src.linesize[1];
+        const uint8_t* v = src.format == YuvFormat::NV12 ? nullptr : src.data[2] + static_cast<std::ptrdiff_t>(c) * src.linesize[2];
+        row(y, u, v, dst + static_cast<std::ptrdiff_t>(r) * dst_linesize, 0, src.width, k);
+    }
+}
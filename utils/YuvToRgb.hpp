@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+enum class YuvFormat {YUV420P, NV12, YUV420P10};
+
+/* Fixed point YUV -> RGB coefficients with 14 fractional bits. Every
+ * kernel evaluates exactly the integer expression of the scalar one,
+ * so all of them produce identical output. */
+struct YuvCoeffs
+{
+    int32_t y_offset;
+    int32_t c_offset;
+    int32_t y;
+    int32_t r_v;
+    int32_t g_u;
+    int32_t g_v;
+    int32_t b_u;
+};
+
+YuvCoeffs yuvCoeffs(double kr, double kb, int bits, bool full_range);
+
+struct YuvImage
+{
+    YuvFormat format{YuvFormat::YUV420P};
+    int width{0};
+    int height{0};
+    const uint8_t* data[3]{nullptr, nullptr, nullptr};
+    int linesize[3]{0, 0, 0};
+};
+
+/* Converts pixels [begin, end) of one row to RGB0 at dst + 4 * begin.
+ * begin must be even. For NV12 u points at the interleaved chroma row
+ * and v is unused, for YUV420P10 the rows hold native endian uint16. */
+using YuvRowFn = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int begin, int end,
+                          const YuvCoeffs& k);
+
+struct YuvKernels
+{
+    const char* name;
+    YuvRowFn row[3];  // indexed by YuvFormat
+};
+
+// scalar reference, always available
+const YuvKernels& yuvScalarKernels();
+// widest kernel set the CPU runs, picked once from CPUID; $VPL_SIMD names one to force it
+const YuvKernels& yuvKernels();
+// kernel set by name ("scalar", "sse4.1", "avx2", "avx512"), null when not built in or not supported by the CPU
+const YuvKernels* yuvKernels(const char* name);
+
+// rows [row_begin, row_end) of src to RGB0 in dst
+void yuvToRgb(const YuvKernels& kernels, const YuvImage& src, const YuvCoeffs& k, uint8_t* dst, int dst_linesize,
+              int row_begin, int row_end);
@@ -0,0 +1,106 @@
+#include "YuvToRgbKernels.hpp"
+#include <immintrin.h>
+
+// 16 pixels per step in 32 bit lanes, built with -mavx512f (AVX-512F only, no BW needed)
+
+namespace
+{
+struct Consts
+{
+    __m512i y_offset, c_offset, y, r_v, g_u, g_v, b_u, round, zero, max, alpha;
+    explicit Consts(const YuvCoeffs& k):
+        y_offset{_mm512_set1_epi32(k.y_offset)},
+        c_offset{_mm512_set1_epi32(k.c_offset)},
+        y{_mm512_set1_epi32(k.y)},
+        r_v{_mm512_set1_epi32(k.r_v)},
+        g_u{_mm512_set1_epi32(k.g_u)},
+        g_v{_mm512_set1_epi32(k.g_v)},
+        b_u{_mm512_set1_epi32(k.b_u)},
+        round{_mm512_set1_epi32(1 << 13)},
+        zero{_mm512_setzero_si512()},
+        max{_mm512_set1_epi32(255)},
+        alpha{_mm512_set1_epi32(static_cast<int>(0xff000000u))}
+    {}
+};
+
+inline __m512i clamp(__m512i x, const Consts& c)
+{
+    return _mm512_min_epi32(_mm512_max_epi32(x, c.zero), c.max);
+}
+
+inline void store(__m512i y, __m512i u, __m512i v, const Consts& c, uint8_t* dst)
+{
+    __m512i l = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_sub_epi32(y, c.y_offset), c.y), c.round);
+    u = _mm512_sub_epi32(u, c.c_offset);
+    v = _mm512_sub_epi32(v, c.c_offset);
+    __m512i r = clamp(_mm512_srai_epi32(_mm512_add_epi32(l, _mm512_mullo_epi32(v, c.r_v)), 14), c);
+    __m512i g = clamp(_mm512_srai_epi32(_mm512_sub_epi32(_mm512_sub_epi32(l, _mm512_mullo_epi32(u, c.g_u)),
+                                                         _mm512_mullo_epi32(v, c.g_v)), 14), c);
+    __m512i b = clamp(_mm512_srai_epi32(_mm512_add_epi32(l, _mm512_mullo_epi32(u, c.b_u)), 14), c);
+    __m512i px = _mm512_or_si512(_mm512_or_si512(r, _mm512_slli_epi32(g, 8)), _mm512_or_si512(_mm512_slli_epi32(b, 16), c.alpha));
+    _mm512_storeu_si512(dst, px);
+}
+
+inline __m128i load64(const void* p)
+{
+    return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+}
+
+inline __m128i load128(const void* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// 8 words to 16, each doubled
+inline __m256i double16(__m128i x)
+{
+    return _mm256_set_m128i(_mm_unpackhi_epi16(x, x), _mm_unpacklo_epi16(x, x));
+}
+
+void yuv420p_row(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int begin, int end, const YuvCoeffs& k)
+{
+    const Consts c{k};
+    int x{begin};
+    for(; x + 16 <= end; x += 16)
+    {
+        __m128i uu = load64(u + (x >> 1));
+        __m128i vv = load64(v + (x >> 1));
+        store(_mm512_cvtepu8_epi32(load128(y + x)), _mm512_cvtepu8_epi32(_mm_unpacklo_epi8(uu, uu)),
+              _mm512_cvtepu8_epi32(_mm_unpacklo_epi8(vv, vv)), c, dst + 4 * x);
+    }
+    yuv420pRowScalar(y, u, v, dst, x, end, k);
+}
+
+void nv12_row(const uint8_t* y, const uint8_t* uv, const uint8_t* unused, uint8_t* dst, int begin, int end, const YuvCoeffs& k)
+{
+    const Consts c{k};
+    const __m128i su = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14);
+    const __m128i sv = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15);
+    int x{begin};
+    for(; x + 16 <= end; x += 16)
+    {
+        __m128i c16 = load128(uv + x);
+        store(_mm512_cvtepu8_epi32(load128(y + x)), _mm512_cvtepu8_epi32(_mm_shuffle_epi8(c16, su)),
+              _mm512_cvtepu8_epi32(_mm_shuffle_epi8(c16, sv)), c, dst + 4 * x);
+    }
+    nv12RowScalar(y, uv, unused, dst, x, end, k);
+}
+
+void yuv420p10_row(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int begin, int end, const YuvCoeffs& k)
+{
+    const Consts c{k};
+    const uint16_t* y16 = reinterpret_cast<const uint16_t*>(y);
+    const uint16_t* u16 = reinterpret_cast<const uint16_t*>(u);
+    const uint16_t* v16 = reinterpret_cast<const uint16_t*>(v);
+    int x{begin};
+    for(; x + 16 <= end; x += 16)
+    {
+        store(_mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(y16 + x))),
+              _mm512_cvtepu16_epi32(double16(load128(u16 + (x >> 1)))),
+              _mm512_cvtepu16_epi32(double16(load128(v16 + (x >> 1)))), c, dst + 4 * x);
+    }
+    yuv420p10RowScalar(y, u, v, dst, x, end, k);
+}
+}
+
+const YuvKernels yuv_kernels_avx512{"avx512", {yuv420p_row, nv12_row, yuv420p10_row}};
@@ -0,0 +1,33 @@
+#pragma once
+#include "YuvToRgb.hpp"
+
+// shared by the kernel translation units only
+
+static inline uint8_t yuv_clamp(int32_t x)
+{
+    return x < 0 ? 0 : x > 255 ? 255 : static_cast<uint8_t>(x);
+}
+
+static inline void yuv_pixel(int32_t y, int32_t u, int32_t v, const YuvCoeffs& k, uint8_t* out)
+{
+    int32_t l = (y - k.y_offset) * k.y + (1 << 13);
+    u -= k.c_offset;
+    v -= k.c_offset;
+    out[0] = yuv_clamp((l + v * k.r_v) >> 14);
+    out[1] = yuv_clamp((l - u * k.g_u - v * k.g_v) >> 14);
+    out[2] = yuv_clamp((l + u * k.b_u) >> 14);
+    out[3] = 255;
+}
+
+void yuv420pRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int begin, int end,
+                      const YuvCoeffs& k);
+void nv12RowScalar(const uint8_t* y, const uint8_t* uv, const uint8_t* unused, uint8_t* dst, int begin, int end,
+                   const YuvCoeffs& k);
+void yuv420p10RowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int begin, int end,
+                        const YuvCoeffs& k);
+
+#ifdef VPL_X86_SIMD
+extern const YuvKernels yuv_kernels_sse41;
+extern const YuvKernels yuv_kernels_avx2;
+extern const YuvKernels yuv_kernels_avx512;
+#endif
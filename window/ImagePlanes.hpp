@@ -0,0 +1,40 @@
+#pragma once
+
+// YUV420P16 and P010 hold 16 bit samples: 10 or 12 bits in the low bits, P010/P016 in the high ones
+enum class PixelLayout
+{
+    RGBA,
+    YUV420P,
+    NV12,
+    YUV420P16,
+    P010
+};
+
+enum class ColorMatrix
+{
+    BT601,
+    BT709,
+    BT2020
+};
+
+enum class TransferCurve
+{
+    SDR,
+    PQ,
+    HLG
+};
+
+/* Plain description of a picture handed to VPLRender::paint.
+ * Planes are not owned, the caller keeps them alive until paint returns. */
+struct ImagePlanes
+{
+    PixelLayout layout{PixelLayout::RGBA};
+    int width{0};
+    int height{0};
+    const unsigned char* data[3]{nullptr, nullptr, nullptr};
+    int linesize[3]{0, 0, 0};
+    ColorMatrix matrix{ColorMatrix::BT709};
+    bool full_range{false};
+    int depth{8};  // significant bits per sample, 16 for P010/P016 whose low bits are padding
+    TransferCurve transfer{TransferCurve::SDR};
+};
@@ -1,10 +1,28 @@
 #include "VPLRender.hpp"
+#include "../utils/Trace.hpp"
+#include "../Commands.hpp"
+#include <cstring>
+#include <algorithm>
+#include <atomic>
 #define EXIT std::exit(EXIT_FAILURE)
 
-extern bool b_pause_play;
-extern bool b_seekable;
-extern std::size_t idx;
-extern double frame_per_sec;
+extern std::atomic<bool> b_pause_play;
+extern std::atomic<double> play_speed;
+extern std::atomic<bool> b_redraw;
+
+static const double speeds[]{0.25, 0.5, 1.0, 1.5, 2.0, 4.0, 8.0, 16.0, 32.0};
+static const int speed_count = sizeof(speeds) / sizeof(speeds[0]);
+
+// next step up (dir 1) or down (dir -1) from the current speed
+static void step_speed(int dir)
+{
+    int i{0};
+    while(i < speed_count - 1 && speeds[i] < play_speed) i++;
+    i = std::max(0, std::min(speed_count - 1, i + dir));
+    if(speeds[i] == play_speed) return;
+    play_speed = speeds[i];
+    commands.push(PlayerCommand{CommandType::Speed, play_speed});
+}
 
 static const char* vertex_shader_src =
         "#version 330 core\n"
@@ -17,14 +35,61 @@ static const char* vertex_shader_src =
         "       coord = vec2(aCoord.x, 1.0 - aCoord.y);\n"
         "};\n";
 
+// pix_layout: 0 packed RGB, 1 three planes Y/U/V, 2 Y plane + interleaved UV plane.
+// sample_scale stretches 10/12 bit samples read from 16 bit textures to the full 0..1.
+// yuv_matrix already carries the range expansion, yuv_offset the black level and chroma zero.
+// transfer 1 (PQ) and 2 (HLG) are tone mapped to SDR: linear light relative to 203 nit reference
+// white, luminance compressed so hdr_peak lands on 1.0, BT.2020 primaries to BT.709, BT.1886 gamma.
 static const char* fragment_shader_src =
         "#version 330 core\n"
         "in vec2 coord;\n"
-        "out vec4 texture;\n"
-        "uniform sampler2D image;\n"
+        "out vec4 color;\n"
+        "uniform sampler2D plane0;\n"
+        "uniform sampler2D plane1;\n"
+        "uniform sampler2D plane2;\n"
+        "uniform int pix_layout;\n"
+        "uniform float sample_scale;\n"
+        "uniform mat3 yuv_matrix;\n"
+        "uniform vec3 yuv_offset;\n"
+        "uniform int transfer;\n"
+        "uniform float hdr_peak;\n"
+        "const vec3 bt2020_luma = vec3(0.2627, 0.6780, 0.0593);\n"
+        "const mat3 bt2020_to_709 = mat3(1.6605, -0.1246, -0.0182, -0.5876, 1.1329, -0.1006, -0.0728, -0.0083, 1.1187);\n"
+        "vec3 pq_to_linear(vec3 e)\n"
+        "{\n"
+        "       vec3 p = pow(e, vec3(1.0 / 78.84375));\n"
+        "       vec3 l = pow(max(p - 0.8359375, 0.0) / (18.8515625 - 18.6875 * p), vec3(1.0 / 0.1593017578125));\n"
+        "       return l * (10000.0 / 203.0);\n"
+        "}\n"
+        "vec3 hlg_to_linear(vec3 e)\n"
+        "{\n"
+        "       vec3 lo = e * e / 3.0;\n"
+        "       vec3 hi = (exp((e - 0.55991073) / 0.17883277) + 0.28466892) / 12.0;\n"
+        "       vec3 scene = mix(lo, hi, step(0.5, e));\n"
+        "       float ys = max(dot(bt2020_luma, scene), 1e-6);\n"
+        "       return scene * pow(ys, 0.2) * (1000.0 / 203.0);\n"
+        "}\n"
         "void main()\n"
         "{\n"
-        "       texture = texture2D(image, coord);\n"
+        "       if(pix_layout == 0)\n"
+        "       {\n"
+        "               color = vec4(texture(plane0, coord).rgb, 1.0);\n"
+        "               return;\n"
+        "       }\n"
+        "       vec3 yuv;\n"
+        "       yuv.x = texture(plane0, coord).r;\n"
+        "       if(pix_layout == 1) yuv.yz = vec2(texture(plane1, coord).r, texture(plane2, coord).r);\n"
+        "       else yuv.yz = texture(plane1, coord).rg;\n"
+        "       vec3 rgb = clamp(yuv_matrix * (yuv * sample_scale - yuv_offset), 0.0, 1.0);\n"
+        "       if(transfer != 0)\n"
+        "       {\n"
+        "               vec3 l = transfer == 1 ? pq_to_linear(rgb) : hlg_to_linear(rgb);\n"
+        "               float y = dot(bt2020_luma, l);\n"
+        "               float m = y * (1.0 + y / (hdr_peak * hdr_peak)) / (1.0 + y);\n"
+        "               l = clamp(bt2020_to_709 * (l * (y > 0.0 ? m / y : 0.0)), 0.0, 1.0);\n"
+        "               rgb = pow(l, vec3(1.0 / 2.4));\n"
+        "       }\n"
+        "       color = vec4(rgb, 1.0);\n"
         "};\n";
 
 bool VPLRender::init_shader()
@@ -66,6 +131,18 @@ bool VPLRender::init_shader()
         glDetachShader(m_obj[5], f_id);
         glDeleteShader(v_id);
         glDeleteShader(f_id);
+
+        glUseProgram(m_obj[5]);
+        glUniform1i(glGetUniformLocation(m_obj[5], "plane0"), 0);
+        glUniform1i(glGetUniformLocation(m_obj[5], "plane1"), 1);
+        glUniform1i(glGetUniformLocation(m_obj[5], "plane2"), 2);
+        m_loc_layout = glGetUniformLocation(m_obj[5], "pix_layout");
+        m_loc_matrix = glGetUniformLocation(m_obj[5], "yuv_matrix");
+        m_loc_offset = glGetUniformLocation(m_obj[5], "yuv_offset");
+        m_loc_scale = glGetUniformLocation(m_obj[5], "sample_scale");
+        m_loc_transfer = glGetUniformLocation(m_obj[5], "transfer");
+        m_loc_peak = glGetUniformLocation(m_obj[5], "hdr_peak");
+        glUseProgram(0);
     }
     catch(shader_error& e)
     {
@@ -97,6 +174,7 @@ void VPLRender::init_gl_obj()
     glGenBuffers(1, &tbo);
     glGenBuffers(1, &ebo);
     glGenTextures(1, &txt);
+    glGenTextures(3, m_planes);
 
     glBindVertexArray(vao);
 
@@ -115,16 +193,27 @@ void VPLRender::init_gl_obj()
 
     glBindVertexArray(0);
 
-    glBindTexture(GL_TEXTURE_2D, txt);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    init_texture(txt);
+    for(int i{0}; i < 3; i++) init_texture(m_planes[i]);
+
+    m_immutable = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    m_persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    for(auto& slot : m_ring) glGenBuffers(1, &slot.pbo);
+}
+
+void VPLRender::init_texture(GLuint tex)
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void VPLRender::review(int width, int height)
+// the size an image of width x height takes on screen: scaled down to fit the framebuffer, never up
+void VPLRender::fitSize(int width, int height, int *fit_w, int *fit_h)
 {
     double sar = static_cast<double>(width) / static_cast<double>(height);
     int w, h, img_w{0}, img_h{0};
@@ -144,9 +233,28 @@ void VPLRender::review(int width, int height)
         img_h = h;
         img_w = static_cast<int>(h * sar);
     }
+    *fit_w = img_w;
+    *fit_h = img_h;
+}
+
+void VPLRender::review(int width, int height)
+{
+    int w, h, img_w, img_h;
+    glfwGetFramebufferSize(m_wnd, &w, &h);
+    fitSize(width, height, &img_w, &img_h);
     glViewport((w - img_w)/2, (h - img_h)/2, img_w, img_h);
 }
 
+void VPLRender::refreshfunc(GLFWwindow *wnd)
+{
+    b_redraw = true;
+}
+
+void VPLRender::resizefunc(GLFWwindow *wnd, int width, int height)
+{
+    b_redraw = true;
+}
+
 void VPLRender::keyfunc(GLFWwindow *wnd, int key, int scancode, int action, int mode)
 {
     switch(key)
@@ -191,40 +299,48 @@ void VPLRender::keyfunc(GLFWwindow *wnd, int key, int scancode, int action, int
         if(action == GLFW_PRESS) b_pause_play = false;
         else if(action == GLFW_RELEASE) b_pause_play = true;
     }break;
-    case GLFW_KEY_UP:
+    case GLFW_KEY_S:
     {
-        if(action == GLFW_PRESS && action != GLFW_REPEAT)
-        {
-            b_seekable = true;
-            idx += (frame_per_sec * 60);
-        }
+        if(action == GLFW_PRESS) commands.push(PlayerCommand{CommandType::SeekMode});
     }break;
-
-    case GLFW_KEY_DOWN:
+    case GLFW_KEY_PERIOD:
+    case GLFW_KEY_COMMA:
     {
-        if(action == GLFW_PRESS && action != GLFW_REPEAT)
+        // a step pauses first
+        if(action == GLFW_PRESS || action == GLFW_REPEAT)
         {
-            b_seekable = true;
-            if(idx >= (frame_per_sec * 60)) idx -= (frame_per_sec * 60);
-            else idx = 0;
+            b_pause_play = true;
+            commands.push(PlayerCommand{CommandType::Step, key == GLFW_KEY_PERIOD ? 1.0 : -1.0});
         }
     }break;
-
-    case GLFW_KEY_RIGHT:
+    case GLFW_KEY_R:
     {
-        if(action == GLFW_PRESS && action != GLFW_REPEAT)
+        if(action == GLFW_PRESS) commands.push(PlayerCommand{CommandType::Reverse});
+    }break;
+    case GLFW_KEY_RIGHT_BRACKET:
+    case GLFW_KEY_LEFT_BRACKET:
+    {
+        if(action == GLFW_PRESS) step_speed(key == GLFW_KEY_RIGHT_BRACKET ? 1 : -1);
+    }break;
+    case GLFW_KEY_BACKSPACE:
+    {
+        if(action == GLFW_PRESS && play_speed != 1.0)
         {
-            b_seekable = true;
-            idx += (frame_per_sec * 30);
+            play_speed = 1.0;
+            commands.push(PlayerCommand{CommandType::Speed, 1.0});
         }
     }break;
+    // held down the repeats pile up as seeks the player merges into one
+    case GLFW_KEY_UP:
+    case GLFW_KEY_DOWN:
+    case GLFW_KEY_RIGHT:
     case GLFW_KEY_LEFT:
     {
-        if(action == GLFW_PRESS && action != GLFW_REPEAT)
+        if(action == GLFW_PRESS || action == GLFW_REPEAT)
         {
-            b_seekable = true;
-            if(idx >= (frame_per_sec * 30)) idx -= (frame_per_sec * 30);
-            else idx = 0;
+            double by = key == GLFW_KEY_UP || key == GLFW_KEY_DOWN ? 60.0 : 30.0;
+            if(key == GLFW_KEY_DOWN || key == GLFW_KEY_LEFT) by = -by;
+            commands.push(PlayerCommand{CommandType::Seek, by});
         }
     }break;
     default: break;
@@ -254,6 +370,8 @@ VPLRender::VPLRender(const std::string &title, int width, int height)
     glfwMakeContextCurrent(m_wnd);
     glfwSetInputMode(m_wnd, GLFW_STICKY_KEYS, GLFW_TRUE);
     glfwSetKeyCallback(m_wnd, keyfunc);
+    glfwSetWindowRefreshCallback(m_wnd, refreshfunc);
+    glfwSetFramebufferSizeCallback(m_wnd, resizefunc);
 
     glewExperimental = true;
     if(glewInit() != GLEW_OK)
@@ -270,7 +388,19 @@ VPLRender::VPLRender(const std::string &title, int width, int height)
 
 VPLRender::~VPLRender()
 {
+    for(auto& slot : m_ring)
+    {
+        if(slot.fence) glDeleteSync(slot.fence);
+        if(slot.mapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.pbo);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     glDeleteProgram(m_obj[5]);
+    glDeleteTextures(3, m_planes);
     glDeleteTextures(1, &m_obj[4]);
     glDeleteBuffers(1, &m_obj[3]);
     glDeleteBuffers(1, &m_obj[2]);
@@ -291,19 +421,270 @@ GLFWwindow *VPLRender::window()
 
 void VPLRender::paint(unsigned char *_data, int image_w, int image_h)
 {
-    glBindTexture(GL_TEXTURE_2D, m_obj[4]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_w, image_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, _data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    ImagePlanes img;
+    img.width = image_w;
+    img.height = image_h;
+    img.data[0] = _data;
+    img.linesize[0] = image_w * 4;
+    paint(img);
+}
+
+void VPLRender::paint(const ImagePlanes &img)
+{
+    VPL_TRACE_SCOPE("VPLRender::paint");
+    struct PlaneSpec
+    {
+        GLuint* tex;
+        int* size;
+        GLenum internal;
+        GLenum format;
+        int w, h, pixel_bytes;
+        GLenum type;
+    };
+    int cw = (img.width + 1) / 2;
+    int ch = (img.height + 1) / 2;
+    PlaneSpec planes[3];
+    int count{0};
+    int layout{0};
+    switch(img.layout)
+    {
+    case PixelLayout::RGBA:
+        planes[count++] = PlaneSpec{&m_obj[4], m_tex_size[3], GL_RGBA8, GL_RGBA, img.width, img.height, 4, GL_UNSIGNED_BYTE};
+        break;
+    case PixelLayout::YUV420P:
+        layout = 1;
+        planes[count++] = PlaneSpec{&m_planes[0], m_tex_size[0], GL_R8, GL_RED, img.width, img.height, 1, GL_UNSIGNED_BYTE};
+        planes[count++] = PlaneSpec{&m_planes[1], m_tex_size[1], GL_R8, GL_RED, cw, ch, 1, GL_UNSIGNED_BYTE};
+        planes[count++] = PlaneSpec{&m_planes[2], m_tex_size[2], GL_R8, GL_RED, cw, ch, 1, GL_UNSIGNED_BYTE};
+        break;
+    case PixelLayout::NV12:
+        layout = 2;
+        planes[count++] = PlaneSpec{&m_planes[0], m_tex_size[0], GL_R8, GL_RED, img.width, img.height, 1, GL_UNSIGNED_BYTE};
+        planes[count++] = PlaneSpec{&m_planes[1], m_tex_size[1], GL_RG8, GL_RG, cw, ch, 2, GL_UNSIGNED_BYTE};
+        break;
+    // high bit depth keeps its samples, normalized 16 bit textures filter like 8 bit ones
+    case PixelLayout::YUV420P16:
+        layout = 1;
+        planes[count++] = PlaneSpec{&m_planes[0], m_tex_size[0], GL_R16, GL_RED, img.width, img.height, 2, GL_UNSIGNED_SHORT};
+        planes[count++] = PlaneSpec{&m_planes[1], m_tex_size[1], GL_R16, GL_RED, cw, ch, 2, GL_UNSIGNED_SHORT};
+        planes[count++] = PlaneSpec{&m_planes[2], m_tex_size[2], GL_R16, GL_RED, cw, ch, 2, GL_UNSIGNED_SHORT};
+        break;
+    case PixelLayout::P010:
+        layout = 2;
+        planes[count++] = PlaneSpec{&m_planes[0], m_tex_size[0], GL_R16, GL_RED, img.width, img.height, 2, GL_UNSIGNED_SHORT};
+        planes[count++] = PlaneSpec{&m_planes[1], m_tex_size[1], GL_RG16, GL_RG, cw, ch, 4, GL_UNSIGNED_SHORT};
+        break;
+    }
+
+    // every plane is copied with its stride into one ring slot, offsets kept 64 byte aligned
+    std::size_t offsets[3]{0, 0, 0};
+    std::size_t total{0};
+    for(int i{0}; i < count; i++)
+    {
+        offsets[i] = total;
+        total += (static_cast<std::size_t>(img.linesize[i]) * planes[i].h + 63) & ~static_cast<std::size_t>(63);
+    }
+    // storage before the ring slot is bound, glTexImage2D would otherwise read from it
+    for(int i{0}; i < count; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        ensure_texture(*planes[i].tex, planes[i].size, planes[i].internal, planes[i].w, planes[i].h);
+    }
+    unsigned char* dst = begin_upload(total);
+    if(dst)
+    {
+        for(int i{0}; i < count; i++)
+            std::memcpy(dst + offsets[i], img.data[i], static_cast<std::size_t>(img.linesize[i]) * planes[i].h);
+        end_upload();
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(int i{0}; i < count; i++)
+    {
+        const PlaneSpec& p = planes[i];
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, *p.tex);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, img.linesize[i] / p.pixel_bytes);
+        const void* src = dst ? reinterpret_cast<const void*>(offsets[i]) : img.data[i];
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, p.w, p.h, p.format, p.type, src);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
     glUseProgram(m_obj[5]);
+    glUniform1i(m_loc_layout, layout);
+    if(layout != 0) set_color(img);
+
+    draw(img.width, img.height);
+    for(int i{0}; i < count; i++) m_shown_tex[i] = *planes[i].tex;
+    m_shown_count = count;
+    m_shown_layout = layout;
+    m_shown_w = img.width;
+    m_shown_h = img.height;
+
+    if(dst)
+    {
+        UploadSlot& slot = m_ring[m_ring_pos];
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_ring_pos = (m_ring_pos + 1) % upload_ring;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    for(int i{count - 1}; i >= 0; i--)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+/* Draws the last painted picture again from the textures it left,
+ * after the window was exposed or resized while nothing new comes. */
+void VPLRender::redraw()
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    if(m_shown_count == 0) return;
+    for(int i{0}; i < m_shown_count; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, m_shown_tex[i]);
+    }
+    glUseProgram(m_obj[5]);
+    glUniform1i(m_loc_layout, m_shown_layout);
+    draw(m_shown_w, m_shown_h);
+    for(int i{m_shown_count - 1}; i >= 0; i--)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+void VPLRender::ensure_texture(GLuint &tex, int *size, GLenum internal, int w, int h)
+{
+    if(size[0] == w && size[1] == h && size[2] == static_cast<int>(internal)) return;
+    if(m_immutable)
+    {
+        // immutable storage can't be resized, a new size needs a new texture object
+        glDeleteTextures(1, &tex);
+        glGenTextures(1, &tex);
+        init_texture(tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexStorage2D(GL_TEXTURE_2D, 1, internal, w, h);
+    }
+    else
+    {
+        GLenum format = internal == GL_RGBA8 ? GL_RGBA : (internal == GL_RG8 || internal == GL_RG16 ? GL_RG : GL_RED);
+        GLenum type = internal == GL_R16 || internal == GL_RG16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal, w, h, 0, format, type, nullptr);
+    }
+    size[0] = w;
+    size[1] = h;
+    size[2] = static_cast<int>(internal);
+}
+
+/* Returns write access to the next ring slot, bound as the unpack buffer.
+ * The slot is only handed out again once the fence placed after the draw
+ * that read it has signaled, so a frame in flight is never overwritten. */
+unsigned char *VPLRender::begin_upload(std::size_t size)
+{
+    UploadSlot& slot = m_ring[m_ring_pos];
+    if(slot.fence)
+    {
+        GLenum ret;
+        do
+        {
+            ret = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+        } while(ret == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
 
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+    if(slot.size < size)
+    {
+        if(m_persistent)
+        {
+            if(slot.mapped) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glDeleteBuffers(1, &slot.pbo);
+            glGenBuffers(1, &slot.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            slot.mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+        }
+        else
+        {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        }
+        slot.size = size;
+    }
+    if(m_persistent && slot.mapped) return slot.mapped;
+
+    void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(!ptr) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return static_cast<unsigned char*>(ptr);
+}
+
+void VPLRender::end_upload()
+{
+    if(!m_persistent || !m_ring[m_ring_pos].mapped) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+}
+
+void VPLRender::set_color(const ImagePlanes &img)
+{
+    double kr{0.2126}, kb{0.0722};
+    if(img.matrix == ColorMatrix::BT601)
+    {
+        kr = 0.299;
+        kb = 0.114;
+    }
+    else if(img.matrix == ColorMatrix::BT2020)
+    {
+        kr = 0.2627;
+        kb = 0.0593;
+    }
+    double kg = 1.0 - kr - kb;
+    // levels scale with the bit depth, samples come in as value / (2^depth - 1)
+    double max = (1 << img.depth) - 1;
+    double step = 1 << (img.depth - 8);
+    double ys{1.0}, cs{1.0};
+    float offset[3]{0.0f, static_cast<float>(128.0 * step / max), static_cast<float>(128.0 * step / max)};
+    if(!img.full_range)
+    {
+        ys = max / (219.0 * step);
+        cs = max / (224.0 * step);
+        offset[0] = static_cast<float>(16.0 * step / max);
+    }
+    // row major, transposed on upload
+    float m[9]{
+        static_cast<float>(ys), 0.0f, static_cast<float>(2.0 * (1.0 - kr) * cs),
+        static_cast<float>(ys), static_cast<float>(-2.0 * kb * (1.0 - kb) / kg * cs), static_cast<float>(-2.0 * kr * (1.0 - kr) / kg * cs),
+        static_cast<float>(ys), static_cast<float>(2.0 * (1.0 - kb) * cs), 0.0f
+    };
+    glUniformMatrix3fv(m_loc_matrix, 1, GL_TRUE, m);
+    glUniform3fv(m_loc_offset, 1, offset);
+    // 10/12 bits sit in the low bits of the 16 bit texture
+    bool low_bits = img.layout == PixelLayout::YUV420P16;
+    glUniform1f(m_loc_scale, low_bits ? static_cast<float>(65535.0 / max) : 1.0f);
+    int transfer = m_tone_map ? static_cast<int>(img.transfer) : 0;
+    glUniform1i(m_loc_transfer, transfer);
+    glUniform1f(m_loc_peak, static_cast<float>(m_hdr_peak / 203.0));
+}
+
+/* PQ and HLG pictures are tone mapped for an SDR display unless turned
+ * off, compressing highlights so peak_nits maps to full white. */
+void VPLRender::toneMap(bool on, double peak_nits)
+{
+    m_tone_map = on;
+    m_hdr_peak = std::max(peak_nits, 203.0);
+}
+
+void VPLRender::draw(int image_w, int image_h)
+{
     review(image_w, image_h);
 
     glBindVertexArray(m_obj[0]);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 shader_error::shader_error(GLuint obj, int shader_type, int len)
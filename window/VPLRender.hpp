@@ -4,6 +4,7 @@
 #include <exception>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "ImagePlanes.hpp"
 
 class shader_error: private std::exception
 {
@@ -14,19 +15,60 @@ public:
     std::string what();
 };
 
+struct UploadSlot
+{
+    GLuint pbo{0};
+    GLsync fence{nullptr};
+    unsigned char* mapped{nullptr};
+    std::size_t size{0};
+};
+
 class VPLRender
 {
 private:
+    static const int upload_ring = 3;
     GLFWwindow* m_wnd{nullptr};
     GLuint m_obj[6];
+    GLuint m_planes[3]{0, 0, 0};
+    int m_tex_size[4][3]{};
+    UploadSlot m_ring[upload_ring];
+    int m_ring_pos{0};
+    bool m_immutable{false};
+    bool m_persistent{false};
+    GLint m_loc_layout{-1};
+    GLint m_loc_matrix{-1};
+    GLint m_loc_offset{-1};
+    GLint m_loc_scale{-1};
+    GLint m_loc_transfer{-1};
+    GLint m_loc_peak{-1};
+    bool m_tone_map{true};
+    double m_hdr_peak{1000.0};
+    // what the last paint() drew, for redraw()
+    GLuint m_shown_tex[3]{0, 0, 0};
+    int m_shown_count{0};
+    int m_shown_layout{0};
+    int m_shown_w{0};
+    int m_shown_h{0};
     bool init_shader();
     void init_gl_obj();
     void review(int width, int height);
+    void init_texture(GLuint tex);
+    void ensure_texture(GLuint& tex, int* size, GLenum internal, int w, int h);
+    unsigned char* begin_upload(std::size_t size);
+    void end_upload();
+    void set_color(const ImagePlanes& img);
+    void draw(int image_w, int image_h);
     static void keyfunc(GLFWwindow* wnd, int key, int scancode, int action, int mode);
+    static void refreshfunc(GLFWwindow* wnd);
+    static void resizefunc(GLFWwindow* wnd, int width, int height);
 public:
     VPLRender(const std::string& title = "VPL", int width = 1024, int height = 768);
     ~VPLRender();
     GLFWwindow* window();
+    void fitSize(int width, int height, int* fit_w, int* fit_h);
     void paint(unsigned char* _data, int image_w, int image_h);
+    void paint(const ImagePlanes& img);
+    void redraw();
+    void toneMap(bool on, double peak_nits = 1000.0);
 };
 